@@ -0,0 +1,425 @@
+/* Benchmarks.
+
+   Each benchmark runs a fixed, seeded workload, so that runs on
+   the same machine can be compared, and prints one line per
+   configuration.  Run "bench" for all of them or "bench NAME..."
+   for some:
+
+     fill: bitmap_set_multiple() on ranges from 2**10 to 2**33
+     bits, against bitmap_set() one bit at a time.
+
+     buddy: buddy_alloc() and buddy_free() against
+     bitmap_scan_and_flip() and bitmap_set_multiple() on the
+     same trace of mixed allocations and frees.
+
+     hash: lookups that hit and lookups that miss in each hash
+     engine, filled to loads from 1/2 to 7/8. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bitmap.h"
+#include "buddy.h"
+#include "hash.h"
+
+/* Returns the current time in seconds. */
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the next pseudo-random number from *STATE, which must
+   not be 0 (xorshift64). */
+static unsigned long long
+next_random (unsigned long long *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/* Range fills. */
+
+#define FILL_MIN_LOG 10         /* Shortest range: 2**10 bits. */
+#define FILL_MAX_LOG 33         /* Longest range: 2**33 bits, 1 GiB. */
+#define FILL_TOTAL ((size_t) 1 << 33)   /* Bits to fill per size. */
+#define FILL_REF_MAX_LOG 26     /* Longest range filled bit by bit. */
+#define FILL_REF_TOTAL ((size_t) 1 << 28)
+
+/* Fills CNT bits of B starting at bit 3, so that neither end is
+   aligned, alternately to true and false, until TOTAL bits have
+   been filled, with bitmap_set_multiple() or, if BY_BIT, with
+   bitmap_set().  Returns the rate in gigabits per second. */
+static double
+time_fill (struct bitmap *b, size_t cnt, size_t total, bool by_bit)
+{
+  size_t rounds = total / cnt, r, i;
+  double start, secs;
+
+  start = now ();
+  for (r = 0; r < rounds; r++)
+    if (by_bit)
+      for (i = 0; i < cnt; i++)
+        bitmap_set (b, 3 + i, !(r & 1));
+    else
+      bitmap_set_multiple (b, 3, cnt, !(r & 1));
+  secs = now () - start;
+  if (bitmap_test (b, 3 + cnt / 2) != (rounds & 1))
+    abort ();
+  return rounds * (double) cnt / secs / 1e9;
+}
+
+/* Times range fills of each power-of-2 length. */
+static void
+bench_fill (void)
+{
+  int log;
+
+  printf ("fill: %zu bits per length, %zu bit by bit\n",
+          FILL_TOTAL, FILL_REF_TOTAL);
+  for (log = FILL_MIN_LOG; log <= FILL_MAX_LOG; log += log < 30 ? 4 : 3)
+    {
+      size_t cnt = (size_t) 1 << log;
+      struct bitmap *b = bitmap_create (cnt + 64);
+
+      if (b == NULL)
+        {
+          printf ("2^%-2d bits  out of memory\n", log);
+          continue;
+        }
+      printf ("2^%-2d bits %9.2f Gbit/s", log,
+              time_fill (b, cnt, FILL_TOTAL, false));
+      if (log <= FILL_REF_MAX_LOG)
+        printf (" %9.2f Gbit/s bit by bit",
+                time_fill (b, cnt, FILL_REF_TOTAL, true));
+      printf ("\n");
+      bitmap_destroy (b);
+    }
+}
+
+/* Allocation trace. */
+
+#define TRACE_PAGES ((size_t) 1 << 18)  /* Pages managed. */
+#define TRACE_OPS 500000                /* Mixed operations. */
+#define TRACE_MAX_ORDER 4               /* Largest run: 16 pages. */
+
+/* One step of an allocation trace.  An allocation of 2**ORDER
+   pages if ALLOC, otherwise a free of the live run numbered PICK
+   modulo the number of live runs. */
+struct trace_op
+  {
+    bool alloc;
+    int order;
+    unsigned pick;
+  };
+
+/* A run that has been allocated and not yet freed. */
+struct live_run
+  {
+    size_t page;
+    int order;
+  };
+
+/* An allocator under test: ALLOC returns the first page of a new
+   run of 2**ORDER pages or BITMAP_ERROR, FREE gives one back. */
+struct allocator
+  {
+    const char *name;
+    size_t (*alloc) (void *, int order);
+    void (*free) (void *, size_t page, int order);
+  };
+
+static size_t
+buddy_alloc_run (void *aux, int order)
+{
+  return buddy_alloc (aux, order);
+}
+
+static void
+buddy_free_run (void *aux, size_t page, int order)
+{
+  buddy_free (aux, page, order);
+}
+
+static size_t
+bitmap_alloc_run (void *aux, int order)
+{
+  return bitmap_scan_and_flip (aux, 0, (size_t) 1 << order, false);
+}
+
+static void
+bitmap_free_run (void *aux, size_t page, int order)
+{
+  bitmap_set_multiple (aux, page, (size_t) 1 << order, false);
+}
+
+/* Makes the trace: allocations of random orders until three
+   quarters of the pages are in use, then TRACE_OPS allocations
+   and frees in equal proportion. */
+static struct trace_op *
+make_trace (size_t *op_cnt)
+{
+  unsigned long long state = 88172645463325252ull;
+  struct trace_op *trace;
+  size_t used = 0, cnt = 0, i;
+
+  trace = malloc ((TRACE_PAGES + TRACE_OPS) * sizeof *trace);
+  if (trace == NULL)
+    return NULL;
+  while (used < TRACE_PAGES / 4 * 3)
+    {
+      struct trace_op *op = &trace[cnt++];
+      op->alloc = true;
+      op->order = next_random (&state) % (TRACE_MAX_ORDER + 1);
+      used += (size_t) 1 << op->order;
+    }
+  for (i = 0; i < TRACE_OPS; i++)
+    {
+      unsigned long long r = next_random (&state);
+      struct trace_op *op = &trace[cnt++];
+      op->alloc = r & 1;
+      op->order = (r >> 1) % (TRACE_MAX_ORDER + 1);
+      op->pick = r >> 32;
+    }
+  *op_cnt = cnt;
+  return trace;
+}
+
+/* Replays the CNT steps of TRACE against allocator A over AUX and
+   prints how long it took and how many allocations failed. */
+static void
+replay (const struct allocator *a, void *aux,
+        const struct trace_op *trace, size_t cnt)
+{
+  struct live_run *live = malloc (cnt * sizeof *live);
+  size_t live_cnt = 0, failed = 0, i;
+  double start, secs;
+
+  if (live == NULL)
+    {
+      printf ("%-16s out of memory\n", a->name);
+      return;
+    }
+
+  start = now ();
+  for (i = 0; i < cnt; i++)
+    {
+      const struct trace_op *op = &trace[i];
+      if (op->alloc)
+        {
+          size_t page = a->alloc (aux, op->order);
+          if (page != BITMAP_ERROR)
+            {
+              live[live_cnt].page = page;
+              live[live_cnt++].order = op->order;
+            }
+          else
+            failed++;
+        }
+      else if (live_cnt > 0)
+        {
+          size_t k = op->pick % live_cnt;
+          a->free (aux, live[k].page, live[k].order);
+          live[k] = live[--live_cnt];
+        }
+    }
+  secs = now () - start;
+  printf ("%-16s %8.3f s %8.1f ns/op %8zu failed\n", a->name,
+          secs, secs * 1e9 / cnt, failed);
+  free (live);
+}
+
+/* Compares the buddy allocator with first-fit bitmap scans. */
+static void
+bench_buddy (void)
+{
+  static const struct allocator buddy = {"buddy",
+                                         buddy_alloc_run, buddy_free_run};
+  static const struct allocator scan = {"scan_and_flip",
+                                        bitmap_alloc_run, bitmap_free_run};
+  struct trace_op *trace;
+  struct buddy *bd;
+  struct bitmap *b;
+  size_t cnt;
+
+  trace = make_trace (&cnt);
+  if (trace == NULL)
+    {
+      printf ("buddy: out of memory\n");
+      return;
+    }
+  printf ("buddy: %zu pages, %zu operations, runs of 1-%d pages\n",
+          TRACE_PAGES, cnt, 1 << TRACE_MAX_ORDER);
+
+  bd = buddy_create (TRACE_PAGES);
+  if (bd != NULL)
+    replay (&buddy, bd, trace, cnt);
+  buddy_destroy (bd);
+
+  b = bitmap_create (TRACE_PAGES);
+  if (b != NULL)
+    replay (&scan, b, trace, cnt);
+  bitmap_destroy (b);
+
+  free (trace);
+}
+
+/* Hash lookups. */
+
+#define HASH_SLOTS ((size_t) 1 << 20)   /* Buckets or slots. */
+#define HASH_ROUNDS 4                   /* Lookups per element. */
+
+/* A hash table element holding KEY. */
+struct hash_item
+  {
+    struct hash_elem elem;
+    int key;
+  };
+
+/* Returns the item that hash element E is embedded in. */
+static const struct hash_item *
+item_of (const struct hash_elem *e)
+{
+  return (const struct hash_item *) ((const char *) e
+                                     - offsetof (struct hash_item, elem));
+}
+
+static unsigned
+item_hash (const struct hash_elem *e, void *aux)
+{
+  return hash_int (item_of (e)->key);
+}
+
+static bool
+item_less (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return item_of (a)->key < item_of (b)->key;
+}
+
+/* Looks up HASH_ROUNDS * CNT keys in H, in a scattered order,
+   each of them I * 2 + MISS for some I less than CNT, and
+   returns the average time per lookup in nanoseconds.  Aborts if
+   a lookup has the wrong result. */
+static double
+time_lookups (struct hash *h, size_t cnt, bool miss)
+{
+  struct hash_item probe;
+  size_t i;
+  double start;
+
+  start = now ();
+  for (i = 0; i < HASH_ROUNDS * cnt; i++)
+    {
+      probe.key = (i * 2654435761u % cnt) * 2 + miss;
+      if ((hash_find (h, &probe.elem) == NULL) != miss)
+        abort ();
+    }
+  return (now () - start) * 1e9 / (HASH_ROUNDS * cnt);
+}
+
+/* Fills each engine with keys 0, 2, 4, ... up to loads of 4/8
+   through 7/8 of HASH_SLOTS buckets or slots, then times lookups
+   of those keys and of the odd keys between them.  The capacity
+   asked for is what makes each engine start with HASH_SLOTS
+   buckets or slots: chained tables plan for 2 elements per
+   bucket, open-addressing ones to be half full.  An engine whose
+   table must grow before reaching a load prints the load it
+   actually has. */
+static void
+bench_hash (void)
+{
+  static const char *names[] = {"chained", "open", "swiss"};
+  static const enum hash_engine engines[] = {HASH_CHAINED, HASH_OPEN,
+                                             HASH_SWISS};
+  struct hash_item *items;
+  int e, eighths;
+
+  items = malloc (HASH_SLOTS * sizeof *items);
+  if (items == NULL)
+    {
+      printf ("hash: out of memory\n");
+      return;
+    }
+  printf ("hash: %zu buckets or slots, %d lookups per element\n",
+          HASH_SLOTS, HASH_ROUNDS);
+
+  for (e = 0; e < 3; e++)
+    for (eighths = 4; eighths <= 7; eighths++)
+      {
+        size_t cnt = HASH_SLOTS / 8 * eighths;
+        size_t capacity = (engines[e] == HASH_CHAINED
+                           ? HASH_SLOTS * 2 : HASH_SLOTS / 2);
+        struct hash h;
+        double hit, miss;
+        size_t i;
+
+        if (!hash_init_with_capacity (&h, engines[e], capacity,
+                                      item_hash, item_less, NULL))
+          {
+            printf ("%-8s out of memory\n", names[e]);
+            continue;
+          }
+        for (i = 0; i < cnt; i++)
+          {
+            items[i].key = i * 2;
+            hash_insert (&h, &items[i].elem);
+          }
+        hit = time_lookups (&h, cnt, false);
+        miss = time_lookups (&h, cnt, true);
+        printf ("%-8s load %.3f %8.1f ns/hit %8.1f ns/miss\n", names[e],
+                (double) hash_size (&h) / h.bucket_cnt, hit, miss);
+        hash_destroy (&h, NULL);
+      }
+  free (items);
+}
+
+/* Benchmarks by name. */
+static const struct
+  {
+    const char *name;
+    void (*run) (void);
+  }
+benches[] =
+  {
+    {"fill", bench_fill},
+    {"buddy", bench_buddy},
+    {"hash", bench_hash},
+  };
+
+#define BENCH_CNT (sizeof benches / sizeof *benches)
+
+int
+main (int argc, char *argv[])
+{
+  size_t i;
+  int j;
+
+  if (argc < 2)
+    {
+      for (i = 0; i < BENCH_CNT; i++)
+        benches[i].run ();
+      return EXIT_SUCCESS;
+    }
+
+  for (j = 1; j < argc; j++)
+    {
+      for (i = 0; i < BENCH_CNT; i++)
+        if (!strcmp (argv[j], benches[i].name))
+          break;
+      if (i == BENCH_CNT)
+        {
+          fprintf (stderr, "bench: unknown benchmark \"%s\"\n", argv[j]);
+          return EXIT_FAILURE;
+        }
+      benches[i].run ();
+    }
+  return EXIT_SUCCESS;
+}
@@ -1,15 +1,26 @@
+#define _GNU_SOURCE
 #include "bitmap.h"
 #include <assert.h>	
 #include "limits.h"	// 		#include <limits.h>
 #include "round.h"	// 		#include <round.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>	
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 #include "hex_dump.h"	
 #define ASSERT(CONDITION) assert(CONDITION)	
 
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
+
 /* Element type.
 
    This must be an unsigned integer type at least as wide as int.
@@ -25,7 +36,9 @@
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.  The unused bits past the end of
+   the last element are always 0; the functions that work on
+   whole elements rely on that. */
 // struct bitmap
 //   {
 //     size_t bit_cnt;     /* Number of bits. */
@@ -71,307 +84,3580 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
-/* Creation and destruction. */
-
-/* Initializes B to be a bitmap of BIT_CNT bits
-   and sets all of its bits to false.
-   Returns true if success, false if memory allocation
-   failed. */
-struct bitmap *
-bitmap_create (size_t bit_cnt) 
+/* Returns a bit mask in which the bit corresponding to START
+   and every higher bit in the same element are set to 1. */
+static inline elem_type
+head_mask (size_t start)
 {
-  struct bitmap *b = malloc (sizeof *b);
-  if (b != NULL)
-    {
-      b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
-        {
-          bitmap_set_all (b, false);
-          return b;
-        }
-      free (b);
-    }
-  return NULL;
+  return (elem_type) -1 << (start % ELEM_BITS);
 }
 
-/* Creates and returns a bitmap with BIT_CNT bits in the
-   BLOCK_SIZE bytes of storage preallocated at BLOCK.
-   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT). */
-struct bitmap *
-bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size )
-	// Remove KERNEL MACRO 'UNUSED')
+/* Returns a bit mask in which the bits below END in the element
+   that contains bit END - 1 are set to 1 and the rest are set
+   to 0. */
+static inline elem_type
+tail_mask (size_t end)
 {
-  struct bitmap *b = block;
-  
-  ASSERT (block_size >= bitmap_buf_size (bit_cnt));
-
-  b->bit_cnt = bit_cnt;
-  b->bits = (elem_type *) (b + 1);
-  bitmap_set_all (b, false);
-  return b;
+  int tail_bits = end % ELEM_BITS;
+  return tail_bits ? ((elem_type) 1 << tail_bits) - 1 : (elem_type) -1;
 }
 
-/* Returns the number of bytes required to accomodate a bitmap
-   with BIT_CNT bits (for use with bitmap_create_in_buf()). */
-size_t
-bitmap_buf_size (size_t bit_cnt) 
+/* Sets the bits of *E selected by MASK to VALUE. */
+static inline void
+set_masked (elem_type *e, elem_type mask, bool value)
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  if (value)
+    *e |= mask;
+  else
+    *e &= ~mask;
 }
 
-/* Destroys bitmap B, freeing its storage.
-   Not for use on bitmaps created by
-   bitmap_create_preallocated(). */
-void
-bitmap_destroy (struct bitmap *b) 
+/* Returns the number of 1 bits in E. */
+static inline size_t
+popcount (elem_type e)
 {
-  if (b != NULL) 
-    {
-      free (b->bits);
-      free (b);
-    }
+  return __builtin_popcountl (e);
 }
 
-/* Bitmap size. */
-
-/* Returns the number of bits in B. */
-size_t
-bitmap_size (const struct bitmap *b)
-{
-  return b->bit_cnt;
-}
+/* Element kernels.
 
-/* Setting and testing single bits. */
+   The loops that look at long stretches of whole elements go
+   through these function pointers.  The portable versions below
+   are the defaults; select_kernels() swaps in SSE4.2 or AVX2
+   versions at startup if CPUID says the processor has them. */
 
-/* Atomically sets the bit numbered IDX in B to VALUE. */
-void
-bitmap_set (struct bitmap *b, size_t idx, bool value) 
+/* Returns the number of 1 bits in the CNT elements at BITS. */
+static size_t
+count_words_scalar (const elem_type *bits, size_t cnt)
 {
-  ASSERT (b != NULL);
-  ASSERT (idx < b->bit_cnt);
-  if (value)
-    bitmap_mark (b, idx);
-  else
-    bitmap_reset (b, idx);
+  size_t ones = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    ones += popcount (bits[i]);
+  return ones;
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
-void
-bitmap_mark (struct bitmap *b, size_t bit_idx) 
+/* Returns the index of the first element in BITS[START...END),
+   exclusive, that differs from PATTERN, or END if they are all
+   equal to it. */
+static size_t
+find_word_not_scalar (const elem_type *bits, size_t start, size_t end,
+                      elem_type pattern)
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+  size_t i;
 
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  for (i = start; i < end; i++)
+    if (bits[i] != pattern)
+      break;
+  return i;
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to false. */
-void
-bitmap_reset (struct bitmap *b, size_t bit_idx) 
-{
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+/* Ways of combining two bitmaps element by element. */
+enum combine_op
+  {
+    COMBINE_AND,                /* A & B. */
+    COMBINE_OR,                 /* A | B. */
+    COMBINE_XOR,                /* A ^ B. */
+    COMBINE_ANDNOT              /* A & ~B. */
+  };
 
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %k1, %k0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+/* Returns A combined with B according to OP. */
+static inline elem_type
+combine (elem_type a, elem_type b, enum combine_op op)
+{
+  switch (op)
+    {
+    case COMBINE_AND:
+      return a & b;
+    case COMBINE_OR:
+      return a | b;
+    case COMBINE_XOR:
+      return a ^ b;
+    default:
+      return a & ~b;
+    }
 }
 
-/* Atomically toggles the bit numbered IDX in B;
-   that is, if it is true, makes it false,
-   and if it is false, makes it true. */
-void
-bitmap_flip (struct bitmap *b, size_t bit_idx) 
+/* Stores A[I] combined with B[I] according to OP into DST[I],
+   for each I less than CNT.  DST may be A or B. */
+static void
+combine_words_scalar (elem_type *dst, const elem_type *a, const elem_type *b,
+                      size_t cnt, enum combine_op op)
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+  size_t i;
 
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  for (i = 0; i < cnt; i++)
+    dst[i] = combine (a[i], b[i], op);
 }
 
-/* Returns the value of the bit numbered IDX in B. */
-bool
-bitmap_test (const struct bitmap *b, size_t idx) 
+/* Returns the number of 1 bits in A[I] combined with B[I]
+   according to OP, over each I less than CNT. */
+static size_t
+combine_count_words_scalar (const elem_type *a, const elem_type *b,
+                            size_t cnt, enum combine_op op)
 {
-  ASSERT (b != NULL);
-  ASSERT (idx < b->bit_cnt);
-  return (b->bits[elem_idx (idx)] & bit_mask (idx)) != 0;
+  size_t ones = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    ones += popcount (combine (a[i], b[i], op));
+  return ones;
 }
 
-/* Setting and testing multiple bits. */
+static size_t (*count_words) (const elem_type *, size_t)
+  = count_words_scalar;
+static size_t (*find_word_not) (const elem_type *, size_t, size_t, elem_type)
+  = find_word_not_scalar;
+static void (*combine_words) (elem_type *, const elem_type *,
+                              const elem_type *, size_t, enum combine_op)
+  = combine_words_scalar;
+static size_t (*combine_count_words) (const elem_type *, const elem_type *,
+                                      size_t, enum combine_op)
+  = combine_count_words_scalar;
 
-/* Sets all bits in B to VALUE. */
-void
-bitmap_set_all (struct bitmap *b, bool value) 
+#ifdef BITMAP_X86
+/* Number of elements in a 128-bit and a 256-bit vector. */
+#define XMM_ELEMS (sizeof (__m128i) / sizeof (elem_type))
+#define YMM_ELEMS (sizeof (__m256i) / sizeof (elem_type))
+
+/* count_words() for processors with the POPCNT instruction,
+   which comes with SSE4.2.  The loop is the portable one; the
+   target attribute lets the compiler use POPCNT for it. */
+__attribute__ ((target ("popcnt")))
+static size_t
+count_words_sse42 (const elem_type *bits, size_t cnt)
 {
-  ASSERT (b != NULL);
+  size_t ones = 0;
+  size_t i;
 
-  bitmap_set_multiple (b, 0, bitmap_size (b), value);
+  for (i = 0; i < cnt; i++)
+    ones += __builtin_popcountl (bits[i]);
+  return ones;
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
-void
-bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
+/* find_word_not() for SSE4.2 processors, comparing XMM_ELEMS
+   elements per step. */
+__attribute__ ((target ("sse4.2")))
+static size_t
+find_word_not_sse42 (const elem_type *bits, size_t start, size_t end,
+                     elem_type pattern)
 {
+  elem_type pat[XMM_ELEMS];
+  __m128i p;
   size_t i;
-  
-  ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = 0; i < XMM_ELEMS; i++)
+    pat[i] = pattern;
+  p = _mm_loadu_si128 ((const __m128i *) pat);
+
+  for (i = start; i + XMM_ELEMS <= end; i += XMM_ELEMS)
+    {
+      __m128i x = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) &bits[i]),
+                                 p);
+      if (!_mm_testz_si128 (x, x))
+        break;
+    }
+  return find_word_not_scalar (bits, i, end, pattern);
 }
 
-/* Returns the number of bits in B between START and START + CNT,
-   exclusive, that are set to VALUE. */
-size_t
-bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+/* Returns X combined with Y according to OP. */
+__attribute__ ((target ("sse4.2")))
+static inline __m128i
+combine_xmm (__m128i x, __m128i y, enum combine_op op)
 {
-  size_t i, value_cnt;
+  switch (op)
+    {
+    case COMBINE_AND:
+      return _mm_and_si128 (x, y);
+    case COMBINE_OR:
+      return _mm_or_si128 (x, y);
+    case COMBINE_XOR:
+      return _mm_xor_si128 (x, y);
+    default:
+      return _mm_andnot_si128 (y, x);
+    }
+}
 
-  ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
+/* combine_words() for SSE4.2 processors. */
+__attribute__ ((target ("sse4.2")))
+static void
+combine_words_sse42 (elem_type *dst, const elem_type *a, const elem_type *b,
+                     size_t cnt, enum combine_op op)
+{
+  size_t i;
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  for (i = 0; i + XMM_ELEMS <= cnt; i += XMM_ELEMS)
+    _mm_storeu_si128 ((__m128i *) &dst[i],
+                      combine_xmm (_mm_loadu_si128 ((const __m128i *) &a[i]),
+                                   _mm_loadu_si128 ((const __m128i *) &b[i]),
+                                   op));
+  combine_words_scalar (&dst[i], &a[i], &b[i], cnt - i, op);
 }
 
-/* Returns true if any bits in B between START and START + CNT,
-   exclusive, are set to VALUE, and false otherwise. */
-bool
-bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+/* combine_count_words() for processors with POPCNT. */
+__attribute__ ((target ("popcnt")))
+static size_t
+combine_count_words_sse42 (const elem_type *a, const elem_type *b,
+                           size_t cnt, enum combine_op op)
 {
+  size_t ones = 0;
   size_t i;
-  
-  ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
 
   for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+    ones += __builtin_popcountl (combine (a[i], b[i], op));
+  return ones;
 }
 
-/* Returns true if any bits in B between START and START + CNT,
-   exclusive, are set to true, and false otherwise.*/
-bool
-bitmap_any (const struct bitmap *b, size_t start, size_t cnt) 
+/* Returns X combined with Y according to OP. */
+__attribute__ ((target ("avx2")))
+static inline __m256i
+combine_ymm (__m256i x, __m256i y, enum combine_op op)
 {
-  return bitmap_contains (b, start, cnt, true);
+  switch (op)
+    {
+    case COMBINE_AND:
+      return _mm256_and_si256 (x, y);
+    case COMBINE_OR:
+      return _mm256_or_si256 (x, y);
+    case COMBINE_XOR:
+      return _mm256_xor_si256 (x, y);
+    default:
+      return _mm256_andnot_si256 (y, x);
+    }
 }
 
-/* Returns true if no bits in B between START and START + CNT,
-   exclusive, are set to true, and false otherwise.*/
-bool
-bitmap_none (const struct bitmap *b, size_t start, size_t cnt) 
+/* Returns the number of 1 bits in each 64-bit lane of V.  Each
+   byte is split into nibbles that index a 16-entry table of bit
+   counts with VPSHUFB, and VPSADBW folds the byte counts into
+   the four lanes, so 256 bits are counted without POPCNT. */
+__attribute__ ((target ("avx2")))
+static inline __m256i
+popcount_ymm (__m256i v)
 {
-  return !bitmap_contains (b, start, cnt, true);
+  const __m256i table = _mm256_setr_epi8 (0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8 (0x0f);
+  __m256i lo = _mm256_and_si256 (v, low_nibbles);
+  __m256i hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low_nibbles);
+  __m256i bytes = _mm256_add_epi8 (_mm256_shuffle_epi8 (table, lo),
+                                   _mm256_shuffle_epi8 (table, hi));
+  return _mm256_sad_epu8 (bytes, _mm256_setzero_si256 ());
 }
 
-/* Returns true if every bit in B between START and START + CNT,
-   exclusive, is set to true, and false otherwise. */
-bool
-bitmap_all (const struct bitmap *b, size_t start, size_t cnt) 
+/* Returns the sum of the four 64-bit lanes of V. */
+__attribute__ ((target ("avx2")))
+static inline size_t
+sum_lanes_ymm (__m256i v)
 {
-  return !bitmap_contains (b, start, cnt, false);
+  uint64_t lanes[4];
+
+  _mm256_storeu_si256 ((__m256i *) lanes, v);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
 }
 
-/* Finding set or unset bits. */
+/* count_words() for AVX2 processors. */
+__attribute__ ((target ("avx2")))
+static size_t
+count_words_avx2 (const elem_type *bits, size_t cnt)
+{
+  __m256i sums = _mm256_setzero_si256 ();
+  size_t i;
 
-/* Finds and returns the starting index of the first group of CNT
-   consecutive bits in B at or after START that are all set to
-   VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
-size_t
-bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+  for (i = 0; i + YMM_ELEMS <= cnt; i += YMM_ELEMS)
+    sums = _mm256_add_epi64 (sums,
+                             popcount_ymm (_mm256_loadu_si256 ((const __m256i *) &bits[i])));
+  return sum_lanes_ymm (sums) + count_words_sse42 (&bits[i], cnt - i);
+}
+
+/* find_word_not() for AVX2 processors, comparing YMM_ELEMS
+   elements per step. */
+__attribute__ ((target ("avx2")))
+static size_t
+find_word_not_avx2 (const elem_type *bits, size_t start, size_t end,
+                    elem_type pattern)
 {
-  ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
+  elem_type pat[YMM_ELEMS];
+  __m256i p;
+  size_t i;
+
+  for (i = 0; i < YMM_ELEMS; i++)
+    pat[i] = pattern;
+  p = _mm256_loadu_si256 ((const __m256i *) pat);
 
-  if (cnt <= b->bit_cnt) 
+  for (i = start; i + YMM_ELEMS <= end; i += YMM_ELEMS)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      __m256i x = _mm256_xor_si256 (_mm256_loadu_si256 ((const __m256i *) &bits[i]),
+                                    p);
+      if (!_mm256_testz_si256 (x, x))
+        break;
     }
-  return BITMAP_ERROR;
+  return find_word_not_scalar (bits, i, end, pattern);
 }
 
-/* Finds the first group of CNT consecutive bits in B at or after
-   START that are all set to VALUE, flips them all to !VALUE,
-   and returns the index of the first bit in the group.
-   If there is no such group, returns BITMAP_ERROR.
-   If CNT is zero, returns 0.
-   Bits are set atomically, but testing bits is not atomic with
-   setting them. */
-size_t
-bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
+/* combine_words() for AVX2 processors. */
+__attribute__ ((target ("avx2")))
+static void
+combine_words_avx2 (elem_type *dst, const elem_type *a, const elem_type *b,
+                    size_t cnt, enum combine_op op)
 {
-  size_t idx = bitmap_scan (b, start, cnt, value);
-  if (idx != BITMAP_ERROR) 
-    bitmap_set_multiple (b, idx, cnt, !value);
-  return idx;
+  size_t i;
+
+  for (i = 0; i + YMM_ELEMS <= cnt; i += YMM_ELEMS)
+    _mm256_storeu_si256 ((__m256i *) &dst[i],
+                         combine_ymm (_mm256_loadu_si256 ((const __m256i *) &a[i]),
+                                      _mm256_loadu_si256 ((const __m256i *) &b[i]),
+                                      op));
+  combine_words_sse42 (&dst[i], &a[i], &b[i], cnt - i, op);
 }
 
-/* Returns the number of bytes needed to store B in a file. */
-size_t
-bitmap_file_size (const struct bitmap *b) 
+/* combine_count_words() for AVX2 processors. */
+__attribute__ ((target ("avx2")))
+static size_t
+combine_count_words_avx2 (const elem_type *a, const elem_type *b,
+                          size_t cnt, enum combine_op op)
 {
-  return byte_cnt (b->bit_cnt);
+  __m256i sums = _mm256_setzero_si256 ();
+  size_t i;
+
+  for (i = 0; i + YMM_ELEMS <= cnt; i += YMM_ELEMS)
+    sums = _mm256_add_epi64 (sums, popcount_ymm (combine_ymm (
+             _mm256_loadu_si256 ((const __m256i *) &a[i]),
+             _mm256_loadu_si256 ((const __m256i *) &b[i]), op)));
+  return (sum_lanes_ymm (sums)
+          + combine_count_words_sse42 (&a[i], &b[i], cnt - i, op));
 }
 
-/* Debugging. */
+/* Chooses the fastest element kernels that the processor
+   supports.  Runs once, before main(). */
+__attribute__ ((constructor))
+static void
+select_kernels (void)
+{
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      count_words = count_words_avx2;
+      find_word_not = find_word_not_avx2;
+      combine_words = combine_words_avx2;
+      combine_count_words = combine_count_words_avx2;
+    }
+  else if (__builtin_cpu_supports ("sse4.2")
+           && __builtin_cpu_supports ("popcnt"))
+    {
+      count_words = count_words_sse42;
+      find_word_not = find_word_not_sse42;
+      combine_words = combine_words_sse42;
+      combine_count_words = combine_count_words_sse42;
+    }
+}
+#endif /* BITMAP_X86 */
 
-/* Dumps the contents of B to the console as hexadecimal. */
-void
-bitmap_dump (const struct bitmap *b) 
+/* Returns the number of trailing 0 bits in E, which must not be
+   0. */
+static inline size_t
+ctz (elem_type e)
 {
-  hex_dump (0, b->bits, byte_cnt (b->bit_cnt)/2, false);
+  return __builtin_ctzl (e);
 }
 
+/* Summary levels.
 
-struct bitmap *bitmap_expand(struct bitmap *bitmap, int size) {
-    // 현재 비트맵의 크기를 확인합니다.
-    size_t old_size = bitmap_size(bitmap);
-    
-    // 요청된 크기가 현재 크기보다 작거나 같으면 확장할 필요가 없습니다.
-    if (size <= old_size) {
-        return bitmap;
-    }
+   A bitmap may optionally carry a summary of which of its
+   elements are uniform, that is, hold only 0s or only 1s.  For
+   each value V, LEVEL1[V] has one bit per element of the bitmap,
+   set if that element holds only V, and LEVEL2[V] has one bit
+   per element of LEVEL1[V], set if that element is all 1s, that
+   is, if all ELEM_BITS bitmap elements it covers hold only V.
+   Bits past the end of either level are kept set, so that a
+   partial last element summarizes correctly.
 
-    // 새 크기로 비트맵을 생성합니다.
-    struct bitmap *new_bitmap = bitmap_create(size);
-    if (new_bitmap == NULL) {
-        // 새 비트맵 생성에 실패했을 경우 NULL을 반환합니다.
-        return NULL;
+   bitmap_scan() uses the summary to jump over long stretches of
+   elements that cannot contain the run it is looking for
+   without touching them. */
+struct bitmap_summary
+  {
+    size_t level1_cnt;          /* Number of elements per LEVEL1. */
+    size_t level2_cnt;          /* Number of elements per LEVEL2. */
+    elem_type *level1[2];       /* One bit per bitmap element. */
+    elem_type *level2[2];       /* One bit per LEVEL1 element. */
+  };
+
+/* Sets or clears the bit numbered IDX in the element array BITS
+   according to VALUE. */
+static inline void
+set_bit (elem_type *bits, size_t idx, bool value)
+{
+  set_masked (&bits[elem_idx (idx)], bit_mask (idx), value);
+}
+
+/* Brings the summary of B up to date for elements FIRST through
+   LAST, inclusive, after they have been modified. */
+static void
+summary_update (struct bitmap *b, size_t first, size_t last)
+{
+  struct bitmap_summary *s = b->summary;
+  size_t last_elem = elem_cnt (b->bit_cnt) - 1;
+  size_t i;
+  int v;
+
+  for (i = first; i <= last; i++)
+    {
+      elem_type used = i == last_elem ? last_mask (b) : (elem_type) -1;
+      elem_type e = b->bits[i] & used;
+      set_bit (s->level1[0], i, e == 0);
+      set_bit (s->level1[1], i, e == used);
     }
+  for (v = 0; v < 2; v++)
+    for (i = elem_idx (first); i <= elem_idx (last); i++)
+      set_bit (s->level2[v], i, s->level1[v][i] == (elem_type) -1);
+}
 
-    // 기존 비트맵의 데이터를 새 비트맵으로 복사합니다.
-    for (size_t i = 0; i < old_size; ++i) {
-        if (bitmap_test(bitmap, i)) {
-            bitmap_mark(new_bitmap, i);
+/* Returns the index of the first element of B in [START, END)
+   that does not hold only VALUE, END if there is none, or START
+   if START >= END. */
+static size_t
+summary_find_mixed (const struct bitmap_summary *s, bool value,
+                    size_t start, size_t end)
+{
+  size_t i = start;
+
+  if (start >= end)
+    return start;
+  while (i < end)
+    {
+      size_t w = elem_idx (i);
+      elem_type mixed = ~s->level1[value][w] & head_mask (i);
+      size_t w2;
+
+      if (mixed != 0)
+        {
+          i = w * ELEM_BITS + ctz (mixed);
+          break;
         }
-    }
 
-    // 기존 비트맵을 파괴합니다.
-    bitmap_destroy(bitmap);
+      /* Every remaining element covered by level-1 element W is
+         uniform.  Use level 2 to find the next level-1 element
+         that is not all 1s. */
+      w++;
+      w2 = elem_idx (w);
+      if (w2 >= s->level2_cnt)
+        return end;
+      mixed = ~s->level2[value][w2] & head_mask (w);
+      while (mixed == 0)
+        {
+          if (++w2 >= s->level2_cnt)
+            return end;
+          mixed = ~s->level2[value][w2];
+        }
+      i = (w2 * ELEM_BITS + ctz (mixed)) * ELEM_BITS;
+    }
+  return i < end ? i : end;
+}
+
+/* Resizes the NEW_CNT-element array *WORDS, which currently has
+   OLD_CNT elements, setting every bit of any new elements.
+   Returns false if memory allocation failed. */
+static bool
+resize_words (elem_type **words, size_t old_cnt, size_t new_cnt)
+{
+  elem_type *p = realloc (*words, new_cnt * sizeof *p);
+
+  if (p == NULL)
+    return false;
+  if (new_cnt > old_cnt)
+    memset (p + old_cnt, 0xff, (new_cnt - old_cnt) * sizeof *p);
+  *words = p;
+  return true;
+}
+
+/* Brings the summary of B up to date after B has been resized
+   from OLD_BIT_CNT bits.  Only the levels' last elements and any
+   new elements are recomputed.  If memory allocation fails, the
+   summary is removed. */
+static void
+summary_resize (struct bitmap *b, size_t old_bit_cnt)
+{
+  struct bitmap_summary *s = b->summary;
+  size_t old_elems = elem_cnt (old_bit_cnt);
+  size_t new_elems = elem_cnt (b->bit_cnt);
+  size_t level1_cnt = elem_cnt (new_elems);
+  size_t level2_cnt = elem_cnt (level1_cnt);
+  size_t i;
+  int v;
+
+  if (new_elems == 0)
+    {
+      bitmap_disable_summary (b);
+      return;
+    }
+
+  for (v = 0; v < 2; v++)
+    {
+      /* Elements, and level-1 elements, dropped off the end
+         become padding, whose bits are always set. */
+      for (i = new_elems; i < old_elems; i++)
+        set_bit (s->level1[v], i, true);
+      for (i = level1_cnt; i < s->level1_cnt; i++)
+        set_bit (s->level2[v], i, true);
+
+      if (!resize_words (&s->level1[v], s->level1_cnt, level1_cnt)
+          || !resize_words (&s->level2[v], s->level2_cnt, level2_cnt))
+        {
+          bitmap_disable_summary (b);
+          return;
+        }
+    }
+  s->level1_cnt = level1_cnt;
+  s->level2_cnt = level2_cnt;
+
+  i = old_elems < new_elems ? old_elems : new_elems;
+  summary_update (b, i > 0 ? i - 1 : 0, new_elems - 1);
+}
+
+/* Rank and select index.
+
+   The index divides a bitmap into superblocks of
+   RANK_SUPER_ELEMS elements, and each superblock into blocks of
+   RANK_BLOCK_ELEMS elements.  It records the number of 1 bits
+   before each superblock and, relative to the start of its
+   superblock, before each block, so that the number of 1 bits
+   before any index is two table entries plus the popcounts of
+   at most RANK_BLOCK_ELEMS elements.  The block counts fit in 16
+   bits, so the whole index takes about 3.5% of the bitmap's
+   size.
+
+   Modifying the bitmap does not rebuild the index.  It only
+   marks the superblocks from the modified one onward as stale,
+   and they are rebuilt, in order, when a query needs them. */
+#define RANK_BLOCK_ELEMS 8
+#define RANK_SUPER_ELEMS 64
+#define RANK_BLOCKS (RANK_SUPER_ELEMS / RANK_BLOCK_ELEMS)
+
+/* Number of 1 bits between select samples. */
+#define SELECT_SAMPLE 4096
+
+struct bitmap_rank
+  {
+    size_t super_cnt;           /* Number of superblocks. */
+    size_t valid_cnt;           /* Number of up-to-date superblocks. */
+    size_t *super;              /* 1 bits before each superblock. */
+    uint16_t *block;            /* 1 bits before each block. */
+    size_t sample_cnt;          /* Number of samples, 0 if stale. */
+    size_t *samples;            /* Superblock of every SELECT_SAMPLE'th 1. */
+  };
+
+/* SUPER has SUPER_CNT + 1 entries, the last one being the total
+   number of 1 bits.  Entries 0 through VALID_CNT of SUPER, and
+   the BLOCK entries of the first VALID_CNT superblocks, are up
+   to date. */
+
+/* Marks the rank index of B stale from element IDX onward. */
+static inline void
+rank_invalidate (struct bitmap *b, size_t idx)
+{
+  struct bitmap_rank *r = b->rank;
+  size_t s = idx / RANK_SUPER_ELEMS;
+
+  if (s < r->valid_cnt)
+    r->valid_cnt = s;
+  r->sample_cnt = 0;
+}
+
+/* Brings the rank index of B up to date for its first END
+   superblocks. */
+static void
+rank_build (const struct bitmap *b, size_t end)
+{
+  struct bitmap_rank *r = b->rank;
+  size_t elems = elem_cnt (b->bit_cnt);
+
+  for (; r->valid_cnt < end; r->valid_cnt++)
+    {
+      size_t s = r->valid_cnt;
+      size_t i = s * RANK_SUPER_ELEMS;
+      size_t stop = i + RANK_SUPER_ELEMS < elems ? i + RANK_SUPER_ELEMS : elems;
+      size_t cnt = 0;
+
+      for (; i < stop; i++)
+        {
+          if (i % RANK_BLOCK_ELEMS == 0)
+            r->block[i / RANK_BLOCK_ELEMS] = cnt;
+          cnt += popcount (b->bits[i]);
+        }
+      r->super[s + 1] = r->super[s] + cnt;
+    }
+}
+
+/* Records in the rank index R, which must be up to date, the
+   superblock that holds every SELECT_SAMPLE'th 1 bit.  Returns
+   false if memory allocation failed. */
+static bool
+rank_sample (struct bitmap_rank *r)
+{
+  size_t cnt = DIV_ROUND_UP (r->super[r->super_cnt], SELECT_SAMPLE);
+  size_t *samples = realloc (r->samples, cnt * sizeof *samples);
+  size_t s, j;
+
+  if (samples == NULL)
+    return false;
+  r->samples = samples;
+
+  for (s = j = 0; j < cnt; j++)
+    {
+      while (r->super[s + 1] <= j * SELECT_SAMPLE)
+        s++;
+      samples[j] = s;
+    }
+  r->sample_cnt = cnt;
+  return true;
+}
+
+/* Resizes the rank index of B after B has been resized from
+   OLD_BIT_CNT bits.  If memory allocation fails, the index is
+   removed. */
+static void
+rank_resize (struct bitmap *b, size_t old_bit_cnt)
+{
+  struct bitmap_rank *r = b->rank;
+  size_t super_cnt = DIV_ROUND_UP (elem_cnt (b->bit_cnt), RANK_SUPER_ELEMS);
+  size_t kept = old_bit_cnt < b->bit_cnt ? old_bit_cnt : b->bit_cnt;
+  size_t *super;
+  uint16_t *block;
+
+  super = realloc (r->super, (super_cnt + 1) * sizeof *super);
+  if (super != NULL)
+    r->super = super;
+  if (super_cnt > 0)
+    {
+      block = realloc (r->block, super_cnt * RANK_BLOCKS * sizeof *block);
+      if (block != NULL)
+        r->block = block;
+    }
+  else
+    {
+      /* realloc() to 0 bytes may free the array and return a null
+         pointer, which cannot be told apart from failure. */
+      free (r->block);
+      r->block = block = NULL;
+    }
+  if (super == NULL || (block == NULL && super_cnt > 0))
+    {
+      bitmap_disable_rank (b);
+      return;
+    }
+
+  /* The last element kept may have gained or lost bits. */
+  r->super_cnt = super_cnt;
+  rank_invalidate (b, kept > 0 ? elem_idx (kept - 1) : 0);
+}
+
+/* Returns the index of the 1 bit in B that has K 1 bits before
+   it among elements START onward, or BITMAP_ERROR if there is no
+   such bit. */
+static size_t
+select_from (const struct bitmap *b, size_t start, size_t k)
+{
+  size_t elems = elem_cnt (b->bit_cnt);
+  size_t i;
+
+  for (i = start; i < elems; i++)
+    {
+      elem_type e = b->bits[i];
+      size_t cnt = popcount (e);
+
+      if (k < cnt)
+        {
+          while (k-- > 0)
+            e &= e - 1;
+          return i * ELEM_BITS + ctz (e);
+        }
+      k -= cnt;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Run index.
+
+   A run index lists every run of B, that is, every maximal group
+   of consecutive bits with the same value, in two kinds of
+   treap: one of all the runs ordered by where they start, and
+   one per value of the runs of that value ordered by length and
+   then start.  The first finds the run that contains a given
+   bit, the second the smallest run that is at least a given
+   length, each in logarithmic expected time.  Each node of a
+   length treap also records the greatest start in its subtree,
+   so that runs before a given bit can be passed over.
+
+   Modifying bits LO through HI - 1 can change only the runs that
+   contain those bits or the bits just before and after them, so
+   those runs are replaced by the runs of the new bits, found a
+   word at a time, merged with whatever is left of the old runs
+   at either end.  The work is thus proportional to the number of
+   bits modified, not to the size of the bitmap. */
+#define BY_START 0              /* Treap of all runs by start. */
+#define BY_LEN 1                /* Treaps of runs by length. */
+
+struct run
+  {
+    size_t start;               /* First bit. */
+    size_t len;                 /* Number of bits. */
+    size_t max_start;           /* Greatest start in BY_LEN subtree. */
+    bool value;                 /* Value of every bit. */
+    unsigned prio;              /* Treap priority, the same in both. */
+    struct run *kid[2][2];      /* Children in each treap. */
+  };
+
+struct bitmap_runs
+  {
+    struct run *by_start;       /* All runs, by start. */
+    struct run *by_len[2];      /* Runs of each value, by length. */
+    unsigned seed;              /* State of the priority generator. */
+  };
+
+/* Returns true if run A comes before run B in treap kind TREE. */
+static inline bool
+run_before (const struct run *a, const struct run *b, int tree)
+{
+  if (tree == BY_LEN && a->len != b->len)
+    return a->len < b->len;
+  return a->start < b->start;
+}
+
+/* Recomputes R's greatest start in treap kind TREE, if that is
+   BY_LEN, from its children's. */
+static inline void
+run_fix (struct run *r, int tree)
+{
+  int d;
+
+  if (tree != BY_LEN)
+    return;
+  r->max_start = r->start;
+  for (d = 0; d < 2; d++)
+    if (r->kid[BY_LEN][d] != NULL
+        && r->kid[BY_LEN][d]->max_start > r->max_start)
+      r->max_start = r->kid[BY_LEN][d]->max_start;
+}
+
+/* Inserts R into the treap of kind TREE rooted at ROOT and
+   returns the new root. */
+static struct run *
+run_insert (struct run *root, struct run *r, int tree)
+{
+  int d;
+
+  if (root == NULL)
+    {
+      r->kid[tree][0] = r->kid[tree][1] = NULL;
+      run_fix (r, tree);
+      return r;
+    }
+
+  d = run_before (root, r, tree);
+  root->kid[tree][d] = run_insert (root->kid[tree][d], r, tree);
+  if (root->kid[tree][d]->prio > root->prio)
+    {
+      /* Rotate the child up. */
+      struct run *k = root->kid[tree][d];
+      root->kid[tree][d] = k->kid[tree][!d];
+      k->kid[tree][!d] = root;
+      run_fix (root, tree);
+      root = k;
+    }
+  run_fix (root, tree);
+  return root;
+}
+
+/* Joins treaps A and B of kind TREE, every run of A coming
+   before every run of B, and returns the root. */
+static struct run *
+run_join (struct run *a, struct run *b, int tree)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (a->prio > b->prio)
+    {
+      a->kid[tree][1] = run_join (a->kid[tree][1], b, tree);
+      run_fix (a, tree);
+      return a;
+    }
+  b->kid[tree][0] = run_join (a, b->kid[tree][0], tree);
+  run_fix (b, tree);
+  return b;
+}
+
+/* Removes R from the treap of kind TREE rooted at ROOT, which
+   must contain it, and returns the new root. */
+static struct run *
+run_remove (struct run *root, struct run *r, int tree)
+{
+  int d;
+
+  if (root == r)
+    return run_join (r->kid[tree][0], r->kid[tree][1], tree);
+  d = run_before (root, r, tree);
+  root->kid[tree][d] = run_remove (root->kid[tree][d], r, tree);
+  run_fix (root, tree);
+  return root;
+}
+
+/* Returns the run in X that contains bit IDX, or a null pointer
+   if IDX is past the last run. */
+static struct run *
+run_at (const struct bitmap_runs *x, size_t idx)
+{
+  struct run *r = x->by_start, *found = NULL;
+
+  while (r != NULL)
+    if (r->start <= idx)
+      {
+        found = r;
+        r = r->kid[BY_START][1];
+      }
+    else
+      r = r->kid[BY_START][0];
+  return found != NULL && idx - found->start < found->len ? found : NULL;
+}
+
+/* Returns the first run, in the length treap rooted at R, that
+   is at least CNT bits long and starts at or after START, or a
+   null pointer if there is none. */
+static struct run *
+run_fit (struct run *r, size_t cnt, size_t start)
+{
+  struct run *found;
+
+  if (r == NULL || r->max_start < start)
+    return NULL;
+  if (r->len >= cnt)
+    {
+      found = run_fit (r->kid[BY_LEN][0], cnt, start);
+      if (found != NULL)
+        return found;
+      if (r->start >= start)
+        return r;
+    }
+  return run_fit (r->kid[BY_LEN][1], cnt, start);
+}
+
+/* Frees every run in the start treap rooted at R. */
+static void
+run_free_all (struct run *r)
+{
+  while (r != NULL)
+    {
+      struct run *next = r->kid[BY_START][1];
+      run_free_all (r->kid[BY_START][0]);
+      free (r);
+      r = next;
+    }
+}
+
+/* Adds a run of LEN bits set to VALUE starting at START to X,
+   reusing a run from *SPARE, a list linked through the start
+   treap's right children, if there is one.  Returns false if
+   memory allocation failed. */
+static bool
+runs_add (struct bitmap_runs *x, struct run **spare,
+          size_t start, size_t len, bool value)
+{
+  struct run *r = *spare;
+
+  if (r != NULL)
+    *spare = r->kid[BY_START][1];
+  else
+    {
+      r = malloc (sizeof *r);
+      if (r == NULL)
+        return false;
+    }
+
+  /* A xorshift generator is random enough for priorities. */
+  x->seed ^= x->seed << 13;
+  x->seed ^= x->seed >> 17;
+  x->seed ^= x->seed << 5;
+
+  r->start = start;
+  r->len = len;
+  r->value = value;
+  r->prio = x->seed;
+  x->by_start = run_insert (x->by_start, r, BY_START);
+  x->by_len[value] = run_insert (x->by_len[value], r, BY_LEN);
+  return true;
+}
+
+/* Returns the index of the first bit in B at or after IDX, and
+   before END, whose value differs from bit IDX's, or END if
+   there is none. */
+static size_t
+run_end (const struct bitmap *b, size_t idx, size_t end)
+{
+  elem_type flip = bitmap_test (b, idx) ? (elem_type) -1 : 0;
+  size_t i = elem_idx (idx);
+  elem_type e = (b->bits[i] ^ flip) & head_mask (idx);
+
+  while (e == 0)
+    {
+      if (++i >= elem_cnt (end))
+        return end;
+      e = b->bits[i] ^ flip;
+    }
+  idx = i * ELEM_BITS + ctz (e);
+  return idx < end ? idx : end;
+}
+
+/* Updates the run index of B after bits LO through OLD_HI - 1
+   have been replaced by bits LO through NEW_HI - 1.  OLD_HI and
+   NEW_HI differ only when B has been resized, and then they are
+   its old and new number of bits.  If memory allocation fails,
+   the index is removed. */
+static void
+runs_update (struct bitmap *b, size_t lo, size_t old_hi, size_t new_hi)
+{
+  struct bitmap_runs *x = b->runs;
+  struct run *spare = NULL;
+  struct run *r;
+  size_t left = lo, right = old_hi;
+  bool left_value = false, right_value = false;
+  size_t cur_start, cur_len = 0;
+  bool cur_value = false;
+  bool ok = true;
+  size_t idx;
+
+  /* Take out the runs that hold bits LO - 1 through OLD_HI,
+     keeping in mind the old values of the bits outside LO
+     through OLD_HI - 1 that they cover. */
+  r = run_at (x, lo > 0 ? lo - 1 : 0);
+  if (r != NULL)
+    {
+      left = r->start;
+      left_value = r->value;
+    }
+  while (r != NULL && r->start <= old_hi)
+    {
+      right = r->start + r->len;
+      right_value = r->value;
+      x->by_start = run_remove (x->by_start, r, BY_START);
+      x->by_len[r->value] = run_remove (x->by_len[r->value], r, BY_LEN);
+      r->kid[BY_START][1] = spare;
+      spare = r;
+      r = run_at (x, right);
+    }
+
+  /* Put back the runs from LEFT to RIGHT, merging the leftover
+     old bits at either end with the new bits next to them. */
+  cur_start = left;
+  if (left < lo)
+    {
+      cur_len = lo - left;
+      cur_value = left_value;
+    }
+  for (idx = lo; idx < new_hi && ok; )
+    {
+      size_t end = run_end (b, idx, new_hi);
+      bool value = bitmap_test (b, idx);
+
+      if (cur_len > 0 && cur_value != value)
+        {
+          ok = runs_add (x, &spare, cur_start, cur_len, cur_value);
+          cur_len = 0;
+        }
+      if (cur_len == 0)
+        {
+          cur_start = idx;
+          cur_value = value;
+        }
+      cur_len += end - idx;
+      idx = end;
+    }
+  if (right > old_hi && ok)
+    {
+      if (cur_len > 0 && cur_value != right_value)
+        {
+          ok = runs_add (x, &spare, cur_start, cur_len, cur_value);
+          cur_len = 0;
+        }
+      if (cur_len == 0)
+        {
+          cur_start = new_hi;
+          cur_value = right_value;
+        }
+      cur_len += right - old_hi;
+    }
+  if (cur_len > 0 && ok)
+    ok = runs_add (x, &spare, cur_start, cur_len, cur_value);
+
+  while (spare != NULL)
+    {
+      r = spare;
+      spare = r->kid[BY_START][1];
+      free (r);
+    }
+  if (!ok)
+    bitmap_disable_runs (b);
+}
+
+/* Returns the start of the smallest run of at least CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE, according to B's run index, or BITMAP_ERROR if there is
+   none.  A run that START falls inside counts only from START
+   on.  Ties go to the lowest start. */
+static size_t
+runs_best_fit (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  const struct bitmap_runs *x = b->runs;
+  struct run *r = run_at (x, start);
+  struct run *fit;
+  size_t len;
+
+  if (r == NULL)
+    return BITMAP_ERROR;
+  if (r->start == start)
+    r = NULL;
+  fit = run_fit (x->by_len[value], cnt, start);
+
+  /* Compare the rest of the run START falls inside with the
+     whole runs after it. */
+  len = r != NULL ? r->start + r->len - start : 0;
+  if (r != NULL && r->value == value && len >= cnt
+      && (fit == NULL || len <= fit->len))
+    return start;
+  return fit != NULL ? fit->start : BITMAP_ERROR;
+}
+
+/* Brings the summary, rank index and run index of B, whichever
+   it has, up to date after elements FIRST through LAST,
+   inclusive, have been modified. */
+static inline void
+note_change (struct bitmap *b, size_t first, size_t last)
+{
+  if (b->summary != NULL)
+    summary_update (b, first, last);
+  if (b->rank != NULL)
+    rank_invalidate (b, first);
+  if (b->runs != NULL)
+    {
+      size_t hi = (last + 1) * ELEM_BITS;
+      if (hi > b->bit_cnt)
+        hi = b->bit_cnt;
+      runs_update (b, first * ELEM_BITS, hi, hi);
+    }
+}
+
+/* Copy-on-write snapshots.
+
+   A bitmap's first snapshot moves its elements into a memory
+   file (see memfd_create(2)) that is mapped shared.  A snapshot
+   is a read-only struct bitmap whose elements are another shared
+   mapping of the same file, so taking one copies nothing: until
+   the live bitmap writes to a page, both see the same physical
+   page.  Just before the live bitmap first writes to a page
+   shared with snapshots, each of those snapshots gets a private
+   copy of the page mapped over its view of it with mremap().
+   Memory use thus grows with the number of pages written since
+   the snapshots were taken, not with the size of the bitmap.
+
+   The live bitmap's SHARED has one bit per page of the file, set
+   if any snapshot still shares the page, so that a write to an
+   unshared page costs one bit test.  Each snapshot's SHARED has
+   a bit for each of its own pages. */
+struct bitmap_cow
+  {
+    int fd;                     /* Live: the memory file; snapshot: -1. */
+    size_t map_size;            /* Bytes mapped at the bitmap's BITS. */
+    struct bitmap *shared;      /* Pages shared with snapshots. */
+    struct bitmap *live;        /* Snapshot: its live bitmap, or null
+                                   once that has been destroyed. */
+    struct bitmap *next;        /* Live: newest snapshot; snapshot:
+                                   next older snapshot. */
+  };
+
+/* Returns the size of a page. */
+static size_t
+page_size (void)
+{
+  static size_t size;
+
+  if (size == 0)
+    size = sysconf (_SC_PAGESIZE);
+  return size;
+}
+
+/* Returns the number of bytes of whole pages needed to map the
+   elements of a bitmap of BIT_CNT bits, at least one page. */
+static size_t
+cow_map_size (size_t bit_cnt)
+{
+  size_t bytes = byte_cnt (bit_cnt);
+
+  return ROUND_UP (bytes > 0 ? bytes : 1, page_size ());
+}
+
+/* Moves the elements of B, which must have been created by
+   bitmap_create(), into a newly created memory file mapped
+   shared, so that snapshots can map them too.  Returns true if
+   successful, false on failure. */
+static bool
+cow_start (struct bitmap *b)
+{
+  struct bitmap_cow *c;
+  size_t size = cow_map_size (b->bit_cnt);
+  void *map;
+
+  /* The bits are about to be freed, so they must have come from
+     bitmap_create(), not a caller's buffer or a file mapping. */
+  ASSERT (b->owns_bits);
+
+  c = calloc (1, sizeof *c);
+  if (c == NULL)
+    return false;
+  c->fd = memfd_create ("bitmap", MFD_CLOEXEC);
+  if (c->fd < 0)
+    goto error;
+  if (ftruncate (c->fd, size) < 0)
+    goto error;
+  c->shared = bitmap_create (size / page_size ());
+  if (c->shared == NULL)
+    goto error;
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+  if (map == MAP_FAILED)
+    goto error;
+
+  memcpy (map, b->bits, byte_cnt (b->bit_cnt));
+  free (b->bits);
+  b->bits = map;
+  b->owns_bits = false;
+  b->elem_cap = size / sizeof (elem_type);
+  c->map_size = size;
+  b->cow = c;
+  return true;
+
+ error:
+  bitmap_destroy (c->shared);
+  if (c->fd >= 0)
+    close (c->fd);
+  free (c);
+  return false;
+}
+
+/* Grows the memory file behind live bitmap B, and B's mapping of
+   it, to hold at least ELEMS elements, at least doubling it.
+   Snapshots keep mapping only the part they had.  Returns true
+   if successful, false on failure. */
+static bool
+cow_grow (struct bitmap *b, size_t elems)
+{
+  struct bitmap_cow *c = b->cow;
+  size_t size = ROUND_UP (elems * sizeof (elem_type), page_size ());
+  void *map;
+
+  ASSERT (c->fd >= 0);
+
+  if (size < c->map_size * 2)
+    size = c->map_size * 2;
+  if (ftruncate (c->fd, size) < 0
+      || bitmap_expand (c->shared, size / page_size ()) == NULL)
+    return false;
+  map = mremap (b->bits, c->map_size, size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return false;
+
+  b->bits = map;
+  b->elem_cap = size / sizeof (elem_type);
+  c->map_size = size;
+  return true;
+}
+
+/* Gives snapshot S a private copy of its page number PAGE, with
+   the page's current contents. */
+static void
+cow_copy_page (struct bitmap *s, size_t page)
+{
+  size_t size = page_size ();
+  char *addr = (char *) s->bits + page * size;
+  void *copy;
+
+  copy = mmap (NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED)
+    goto error;
+  memcpy (copy, addr, size);
+  if (mprotect (copy, size, PROT_READ) < 0
+      || mremap (copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED,
+                 addr) == MAP_FAILED)
+    goto error;
+  bitmap_reset (s->cow->shared, page);
+  return;
+
+ error:
+  /* The functions that modify bits cannot fail, and carrying on
+     would let the write show through in the snapshot. */
+  fprintf (stderr, "bitmap: cannot copy snapshot page\n");
+  abort ();
+}
+
+/* Gives every snapshot of B that still shares a page holding any
+   of elements FIRST through LAST, inclusive, its own copy of the
+   page. */
+static void
+cow_prepare (struct bitmap *b, size_t first, size_t last)
+{
+  struct bitmap_cow *c = b->cow;
+  size_t per_page = page_size () / sizeof (elem_type);
+  size_t end = last / per_page + 1;
+  size_t page;
+
+  ASSERT (c->fd >= 0);          /* Snapshots are read-only. */
+
+  if (end > bitmap_size (c->shared))
+    end = bitmap_size (c->shared);
+  if (first / per_page >= end)
+    return;
+  for (page = bitmap_next_set (c->shared, first / per_page); page < end;
+       page = bitmap_next_set (c->shared, page + 1))
+    {
+      struct bitmap *s;
+
+      for (s = c->next; s != NULL; s = s->cow->next)
+        if (page < bitmap_size (s->cow->shared)
+            && bitmap_test (s->cow->shared, page))
+          cow_copy_page (s, page);
+      bitmap_reset (c->shared, page);
+    }
+}
+
+/* Sparse bitmaps.
+
+   A sparse bitmap, made by bitmap_create_sparse(), keeps its
+   elements in an anonymous private mapping reserved without swap
+   backing.  Until a page of the mapping is first written, reading
+   it maps the kernel's shared zero page, so a huge bitmap that is
+   mostly false costs memory only for the pages that hold true
+   bits.
+
+   PRESENT has one bit per page of the mapping, set once the page
+   may hold a 1 bit.  Pages whose bit is clear are known to hold
+   only 0 bits, so counting and scanning skip them without reading
+   them, and clearing bits never writes to them.  Clearing a whole
+   present page gives it back to the kernel with madvise() and
+   clears its bit again. */
+struct bitmap_sparse
+  {
+    size_t map_size;            /* Bytes mapped at the bitmap's BITS. */
+    struct bitmap *present;     /* Pages that may hold 1 bits. */
+  };
+
+/* Returns the number of bits in a page of elements. */
+static inline size_t
+page_bits (void)
+{
+  return page_size () * CHAR_BIT;
+}
+
+/* Returns the number of elements in a page. */
+static inline size_t
+page_elems (void)
+{
+  return page_size () / sizeof (elem_type);
+}
+
+/* Returns true if the page of sparse bitmap B that holds element
+   IDX may hold 1 bits. */
+static inline bool
+sparse_present (const struct bitmap *b, size_t idx)
+{
+  return bitmap_test (b->sparse->present, idx / page_elems ());
+}
+
+/* Returns the first element at or after element IDX of sparse
+   bitmap B that lies in a present page, or END if there is none
+   before END. */
+static size_t
+sparse_skip (const struct bitmap *b, size_t idx, size_t end)
+{
+  size_t page;
+
+  if (idx >= end || sparse_present (b, idx))
+    return idx;
+  page = bitmap_next_set (b->sparse->present, idx / page_elems ());
+  if (page == BITMAP_ERROR || page * page_elems () >= end)
+    return end;
+  return page * page_elems ();
+}
+
+/* Returns the element just past the page that holds element IDX,
+   or END if that comes first. */
+static inline size_t
+page_end (size_t idx, size_t end)
+{
+  size_t next = (idx / page_elems () + 1) * page_elems ();
+
+  return next < end ? next : end;
+}
+
+/* Records that elements FIRST through LAST, inclusive, of sparse
+   bitmap B are about to be written. */
+static void
+sparse_touch (struct bitmap *b, size_t first, size_t last)
+{
+  size_t first_page = first / page_elems ();
+  size_t last_page = last / page_elems ();
+
+  if (first_page == last_page)
+    bitmap_mark (b->sparse->present, first_page);
+  else
+    bitmap_set_multiple (b->sparse->present, first_page,
+                         last_page - first_page + 1, true);
+}
+
+/* Grows the mapping behind sparse bitmap B to hold at least
+   ELEMS elements, at least doubling it.  The new pages read as
+   0 bits.  Returns true if successful, false on failure. */
+static bool
+sparse_grow (struct bitmap *b, size_t elems)
+{
+  struct bitmap_sparse *sp = b->sparse;
+  size_t size = ROUND_UP (elems * sizeof (elem_type), page_size ());
+  void *map;
+
+  if (size < sp->map_size * 2)
+    size = sp->map_size * 2;
+  if (bitmap_expand (sp->present, size / page_size ()) == NULL)
+    return false;
+  map = mremap (b->bits, sp->map_size, size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return false;
+
+  b->bits = map;
+  b->elem_cap = size / sizeof (elem_type);
+  sp->map_size = size;
+  return true;
+}
+
+/* Sets the CNT bits starting at START in B to VALUE, without
+   preparing for or noting the change. */
+static void
+set_range (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  /* Only the first and last elements can be partially covered.
+     Everything in between is filled a whole element at a time. */
+  size_t first = elem_idx (start);
+  size_t last = elem_idx (start + cnt - 1);
+
+  if (first == last)
+    set_masked (&b->bits[first], head_mask (start) & tail_mask (start + cnt),
+                value);
+  else
+    {
+      set_masked (&b->bits[first], head_mask (start), value);
+      memset (&b->bits[first + 1], value ? 0xff : 0,
+              (last - first - 1) * sizeof (elem_type));
+      set_masked (&b->bits[last], tail_mask (start + cnt), value);
+    }
+}
+
+/* Sets the CNT bits starting at START in sparse bitmap B to
+   false.  Only present pages are written; those wholly cleared,
+   counting the unused bits past the end of B as covered, are
+   dropped instead.  CNT must be nonzero. */
+static void
+sparse_clear (struct bitmap *b, size_t start, size_t cnt)
+{
+  struct bitmap *present = b->sparse->present;
+  size_t end = start + cnt;
+  size_t page;
+
+  for (page = bitmap_next_set (present, start / page_bits ());
+       page != BITMAP_ERROR && page * page_bits () < end;
+       page = bitmap_next_set (present, page + 1))
+    {
+      size_t lo = page * page_bits ();
+      size_t hi = lo + page_bits ();
+
+      if (hi > b->bit_cnt)
+        hi = b->bit_cnt;
+      if (lo >= start && hi <= end)
+        {
+          madvise ((char *) b->bits + page * page_size (), page_size (),
+                   MADV_DONTNEED);
+          bitmap_reset (present, page);
+        }
+      else
+        {
+          if (lo < start)
+            lo = start;
+          if (hi > end)
+            hi = end;
+          set_range (b, lo, hi - lo, false);
+        }
+    }
+}
+
+/* Returns the number of 1 bits in B between START and START +
+   CNT, exclusive.  CNT must be nonzero. */
+static size_t
+count_ones (const struct bitmap *b, size_t start, size_t cnt)
+{
+  size_t first = elem_idx (start);
+  size_t last = elem_idx (start + cnt - 1);
+
+  if (first == last)
+    return popcount (b->bits[first]
+                     & head_mask (start) & tail_mask (start + cnt));
+  return (popcount (b->bits[first] & head_mask (start))
+          + count_words (&b->bits[first + 1], last - first - 1)
+          + popcount (b->bits[last] & tail_mask (start + cnt)));
+}
+
+/* Returns the number of 1 bits in sparse bitmap B between START
+   and START + CNT, exclusive, looking only at present pages.
+   CNT must be nonzero. */
+static size_t
+sparse_count_ones (const struct bitmap *b, size_t start, size_t cnt)
+{
+  struct bitmap *present = b->sparse->present;
+  size_t end = start + cnt;
+  size_t ones = 0;
+  size_t page;
+
+  for (page = bitmap_next_set (present, start / page_bits ());
+       page != BITMAP_ERROR && page * page_bits () < end;
+       page = bitmap_next_set (present, page + 1))
+    {
+      size_t lo = page * page_bits ();
+      size_t hi = lo + page_bits ();
+
+      if (lo < start)
+        lo = start;
+      if (hi > end)
+        hi = end;
+      ones += count_ones (b, lo, hi - lo);
+    }
+  return ones;
+}
+
+/* Prepares B for modifying elements FIRST through LAST,
+   inclusive, by copying them out of the way of B's snapshots, if
+   it has any, and by marking their pages present if B is
+   sparse. */
+static inline void
+prepare_write (struct bitmap *b, size_t first, size_t last)
+{
+  if (b->cow != NULL)
+    cow_prepare (b, first, last);
+  if (b->sparse != NULL)
+    sparse_touch (b, first, last);
+}
+
+/* Returns true if B has snapshots. */
+static inline bool
+has_snapshots (const struct bitmap *b)
+{
+  return b->cow != NULL && b->cow->next != NULL;
+}
+
+/* Unmaps the elements of B, which is a live bitmap or a
+   snapshot, and frees its copy-on-write state. */
+static void
+cow_release (struct bitmap *b)
+{
+  struct bitmap_cow *c = b->cow;
+
+  if (c->fd >= 0)
+    {
+      /* The snapshots' mappings keep the memory file alive. */
+      struct bitmap *s;
+
+      for (s = c->next; s != NULL; s = s->cow->next)
+        s->cow->live = NULL;
+      close (c->fd);
+    }
+  else if (c->live != NULL)
+    {
+      struct bitmap_cow *lc = c->live->cow;
+      struct bitmap **p;
+
+      for (p = &lc->next; *p != b; p = &(*p)->cow->next)
+        continue;
+      *p = c->next;
+      if (lc->next == NULL)
+        bitmap_set_all (lc->shared, false);
+    }
+
+  munmap (b->bits, c->map_size);
+  bitmap_destroy (c->shared);
+  free (c);
+  b->cow = NULL;
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B between START and END, exclusive, that
+   are all set to VALUE, or BITMAP_ERROR if there is none.  CNT
+   must be nonzero.
+
+   B is walked an element at a time.  Elements that hold nothing
+   but !VALUE are skipped outright, elements that hold nothing
+   but VALUE extend the current run by ELEM_BITS, and mixed
+   elements are split into runs with ctz(), so the cost is linear
+   in the number of elements, not in the number of bits times
+   CNT. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+            bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t first, last, i;
+  size_t run_start = 0, run_len = 0;
+
+  ASSERT (cnt > 0);
+  if (end < start || end - start < cnt)
+    return BITMAP_ERROR;
+
+  first = elem_idx (start);
+  last = elem_idx (end - 1);
+  for (i = first; i <= last; i++)
+    {
+      /* E has a 1 bit wherever B has VALUE within range. */
+      elem_type e;
+      size_t base = i * ELEM_BITS;
+      size_t limit = last;
+      size_t bit;
+
+      if (b->sparse != NULL)
+        {
+          /* Absent pages hold only 0 bits, so a run of them is
+             skipped or taken whole without being read.  Skipping
+             within a present page stops at the end of the page. */
+          size_t stop = sparse_skip (b, i, last + 1);
+
+          if (stop > i)
+            {
+              if (value)
+                run_len = 0;
+              else
+                {
+                  size_t lo = base > start ? base : start;
+                  size_t hi = stop * ELEM_BITS < end ? stop * ELEM_BITS : end;
+
+                  if (run_len == 0)
+                    run_start = lo;
+                  run_len += hi - lo;
+                  if (run_len >= cnt)
+                    return run_start;
+                }
+              i = stop - 1;
+              continue;
+            }
+          limit = page_end (i, last);
+        }
+
+      e = b->bits[i] ^ flip;
+      if (i == first)
+        e &= head_mask (start);
+      if (i == last)
+        e &= tail_mask (end);
+
+      if (e == 0)
+        {
+          /* Skip every following element that also holds only
+             !VALUE.  The last element is always examined on its
+             own because it may need masking. */
+          run_len = 0;
+          if (b->summary != NULL)
+            i = summary_find_mixed (b->summary, !value, i + 1, limit) - 1;
+          else
+            i = find_word_not (b->bits, i + 1, limit, flip) - 1;
+          continue;
+        }
+      if (e == (elem_type) -1)
+        {
+          if (run_len == 0)
+            run_start = base;
+          run_len += ELEM_BITS;
+          if (run_len >= cnt)
+            return run_start;
+          continue;
+        }
+
+      for (bit = 0; bit < ELEM_BITS; )
+        {
+          elem_type rest = e >> bit;
+          size_t ones;
+
+          if (rest == 0)
+            {
+              run_len = 0;
+              break;
+            }
+          if ((rest & 1) == 0)
+            {
+              run_len = 0;
+              bit += ctz (rest);
+              rest = e >> bit;
+            }
+
+          /* REST has at least one 0 bit shifted in at the top or
+             came from an element that is not all 1s, so ~REST is
+             nonzero. */
+          ones = ctz (~rest);
+          if (run_len == 0)
+            run_start = base + bit;
+          run_len += ones;
+          if (run_len >= cnt)
+            return run_start;
+          bit += ones;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or BITMAP_ERROR if there is none.  Elements
+   holding nothing but !VALUE are skipped using the summary or
+   find_word_not(), and the bit is then found with ctz(), so the
+   cost is proportional to the number of elements skipped over
+   rather than the number of bits. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t elems = elem_cnt (b->bit_cnt);
+  size_t i, idx;
+  elem_type e;
+
+  if (start >= b->bit_cnt)
+    return BITMAP_ERROR;
+
+  i = elem_idx (start);
+  e = (b->bits[i] ^ flip) & head_mask (start);
+  while (e == 0)
+    {
+      size_t limit = elems;
+
+      if (b->sparse != NULL && value)
+        {
+          /* Absent pages hold no 1 bits.  Look through one present
+             page at a time. */
+          i = sparse_skip (b, i + 1, elems) - 1;
+          limit = page_end (i + 1, elems);
+        }
+      if (b->summary != NULL)
+        i = summary_find_mixed (b->summary, !value, i + 1, limit);
+      else
+        i = find_word_not (b->bits, i + 1, limit, flip);
+      if (i >= elems)
+        return BITMAP_ERROR;
+      if (i == limit)
+        {
+          i--;
+          continue;
+        }
+      e = b->bits[i] ^ flip;
+    }
+
+  /* When looking for false bits, the unused bits past the end
+     look like false bits too. */
+  idx = i * ELEM_BITS + ctz (e);
+  return idx < b->bit_cnt ? idx : BITMAP_ERROR;
+}
+
+/* Creation and destruction. */
+
+/* Initializes B to be a bitmap of BIT_CNT bits
+   and sets all of its bits to false.
+   Returns true if success, false if memory allocation
+   failed. */
+struct bitmap *
+bitmap_create (size_t bit_cnt) 
+{
+  struct bitmap *b = malloc (sizeof *b);
+  if (b != NULL)
+    {
+      b->bit_cnt = bit_cnt;
+      b->elem_cap = elem_cnt (bit_cnt);
+      b->summary = NULL;
+      b->rank = NULL;
+      b->runs = NULL;
+      b->rotor = 0;
+      b->cow = NULL;
+      b->sparse = NULL;
+      b->owns_bits = true;
+      b->bits = malloc (byte_cnt (bit_cnt));
+      if (b->bits != NULL || bit_cnt == 0)
+        {
+          bitmap_set_all (b, false);
+          return b;
+        }
+      free (b);
+    }
+  return NULL;
+}
+
+/* Creates and returns a sparse bitmap of BIT_CNT bits, all set
+   to false, or a null pointer if memory allocation failed.
+
+   The bits take address space for all BIT_CNT bits but memory
+   only for the pages of elements that have been set to true, so
+   BIT_CNT may be far larger than physical memory: a bitmap of
+   2**40 bits reserves 128 GiB of address space but starts out
+   using just its 4 MiB of per-page bookkeeping.  Counting and
+   scanning skip the pages that were never set, and clearing
+   bits never makes a page take memory.  Setting all the bits
+   with bitmap_set_all() or writing to the bitmap with
+   bitmap_and() and friends touches every page, though.  A sparse
+   bitmap cannot be snapshotted or used with the atomic
+   operations. */
+struct bitmap *
+bitmap_create_sparse (size_t bit_cnt)
+{
+  struct bitmap *b;
+  struct bitmap_sparse *sp = malloc (sizeof *sp);
+  size_t size = cow_map_size (bit_cnt);
+
+  if (sp == NULL)
+    return NULL;
+  sp->map_size = size;
+  sp->present = NULL;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    goto error;
+  sp->present = bitmap_create (size / page_size ());
+  if (sp->present == NULL)
+    goto error;
+  b->bits = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (b->bits == MAP_FAILED)
+    goto error;
+
+  b->bit_cnt = bit_cnt;
+  b->elem_cap = size / sizeof (elem_type);
+  b->summary = NULL;
+  b->rank = NULL;
+  b->runs = NULL;
+  b->rotor = 0;
+  b->cow = NULL;
+  b->sparse = sp;
+  b->owns_bits = false;
+  return b;
+
+ error:
+  bitmap_destroy (sp->present);
+  free (sp);
+  free (b);
+  return NULL;
+}
+
+/* Creates and returns a bitmap with BIT_CNT bits in the
+   BLOCK_SIZE bytes of storage preallocated at BLOCK.
+   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT).
+   The bitmap cannot be resized: bitmap_expand() and
+   bitmap_shrink() return a null pointer for it. */
+struct bitmap *
+bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size )
+	// Remove KERNEL MACRO 'UNUSED')
+{
+  struct bitmap *b = block;
+  
+  ASSERT (block_size >= bitmap_buf_size (bit_cnt));
+
+  b->bit_cnt = bit_cnt;
+  b->elem_cap = elem_cnt (bit_cnt);
+  b->bits = (elem_type *) (b + 1);
+  b->summary = NULL;
+  b->rank = NULL;
+  b->runs = NULL;
+  b->rotor = 0;
+  b->cow = NULL;
+  b->sparse = NULL;
+  b->owns_bits = false;
+  bitmap_set_all (b, false);
+  return b;
+}
+
+/* Returns the number of bytes required to accomodate a bitmap
+   with BIT_CNT bits (for use with bitmap_create_in_buf()). */
+size_t
+bitmap_buf_size (size_t bit_cnt) 
+{
+  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+}
+
+/* Destroys bitmap B, freeing its storage.
+   Not for use on bitmaps created by
+   bitmap_create_preallocated() or bitmap_open_mmap(). */
+void
+bitmap_destroy (struct bitmap *b) 
+{
+  if (b != NULL) 
+    {
+      bitmap_disable_summary (b);
+      bitmap_disable_rank (b);
+      bitmap_disable_runs (b);
+      if (b->cow != NULL)
+        cow_release (b);
+      else if (b->sparse != NULL)
+        {
+          munmap (b->bits, b->sparse->map_size);
+          bitmap_destroy (b->sparse->present);
+          free (b->sparse);
+        }
+      else
+        free (b->bits);
+      free (b);
+    }
+}
+
+/* Bitmap size. */
+
+/* Returns the number of bits in B. */
+size_t
+bitmap_size (const struct bitmap *b)
+{
+  return b->bit_cnt;
+}
+
+/* Setting and testing single bits. */
+
+/* Atomically sets the bit numbered IDX in B to VALUE. */
+void
+bitmap_set (struct bitmap *b, size_t idx, bool value) 
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+  if (value)
+    bitmap_mark (b, idx);
+  else
+    bitmap_reset (b, idx);
+}
+
+/* Atomically sets the bit numbered BIT_IDX in B to true. */
+void
+bitmap_mark (struct bitmap *b, size_t bit_idx) 
+{
+  size_t idx = elem_idx (bit_idx);
+  elem_type mask = bit_mask (bit_idx);
+
+  /* This is equivalent to `b->bits[idx] |= mask' except that it
+     is guaranteed to be atomic on a uniprocessor machine.  See
+     the description of the OR instruction in [IA32-v2b].  The
+     operand size follows elem_type, so every bit of the element
+     can be reached.  Use bitmap_atomic_mark() on a
+     multiprocessor. */
+  prepare_write (b, idx, idx);
+  asm ("or %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+
+  note_change (b, idx, idx);
+}
+
+/* Atomically sets the bit numbered BIT_IDX in B to false. */
+void
+bitmap_reset (struct bitmap *b, size_t bit_idx) 
+{
+  size_t idx = elem_idx (bit_idx);
+  elem_type mask = bit_mask (bit_idx);
+
+  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
+     is guaranteed to be atomic on a uniprocessor machine.  See
+     the description of the AND instruction in [IA32-v2a].  Use
+     bitmap_atomic_reset() on a multiprocessor. */
+  if (b->sparse != NULL && !sparse_present (b, idx))
+    return;
+  prepare_write (b, idx, idx);
+  asm ("and %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
+
+  note_change (b, idx, idx);
+}
+
+/* Atomically toggles the bit numbered IDX in B;
+   that is, if it is true, makes it false,
+   and if it is false, makes it true. */
+void
+bitmap_flip (struct bitmap *b, size_t bit_idx) 
+{
+  size_t idx = elem_idx (bit_idx);
+  elem_type mask = bit_mask (bit_idx);
+
+  /* This is equivalent to `b->bits[idx] ^= mask' except that it
+     is guaranteed to be atomic on a uniprocessor machine.  See
+     the description of the XOR instruction in [IA32-v2b].  Use
+     bitmap_atomic_flip() on a multiprocessor. */
+  prepare_write (b, idx, idx);
+  asm ("xor %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+
+  note_change (b, idx, idx);
+}
+
+/* Returns the value of the bit numbered IDX in B. */
+bool
+bitmap_test (const struct bitmap *b, size_t idx) 
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+  return (b->bits[elem_idx (idx)] & bit_mask (idx)) != 0;
+}
+
+/* Setting and testing multiple bits. */
+
+/* Sets all bits in B to VALUE. */
+void
+bitmap_set_all (struct bitmap *b, bool value) 
+{
+  size_t cnt;
+
+  ASSERT (b != NULL);
+
+  /* Unlike bitmap_set_multiple(), this writes the unused bits past
+     the end of the last element too, so that they start out 0 in
+     a newly created bitmap. */
+  cnt = elem_cnt (b->bit_cnt);
+  if (cnt == 0)
+    return;
+  if (b->sparse != NULL && !value)
+    sparse_clear (b, 0, b->bit_cnt);
+  else
+    {
+      prepare_write (b, 0, cnt - 1);
+      memset (b->bits, value ? 0xff : 0, cnt * sizeof (elem_type));
+      if (value)
+        b->bits[cnt - 1] &= last_mask (b);
+    }
+
+  note_change (b, 0, cnt - 1);
+}
+
+/* Sets the CNT bits starting at START in B to VALUE. */
+void
+bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t first, last;
+  
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  if (b->sparse != NULL && !value)
+    sparse_clear (b, start, cnt);
+  else
+    {
+      prepare_write (b, first, last);
+      set_range (b, start, cnt, value);
+    }
+
+  note_change (b, first, last);
+}
+
+/* Returns the number of bits in B between START and START + CNT,
+   exclusive, that are set to VALUE. */
+size_t
+bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t ones;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return 0;
+
+  if (b->sparse != NULL)
+    ones = sparse_count_ones (b, start, cnt);
+  else
+    ones = count_ones (b, start, cnt);
+  return value ? ones : cnt - ones;
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to VALUE, and false otherwise. */
+bool
+bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t first, last;
+  elem_type head, tail, pattern;
+  
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return false;
+
+  /* In a sparse bitmap, only the present pages need to be
+     looked at. */
+  if (b->sparse != NULL)
+    return bitmap_count (b, start, cnt, value) != 0;
+
+  /* Looking for a 1 bit means looking for an element that is
+     not all 0s, and vice versa.  Masking the partial elements
+     keeps bits outside the range, including the unused bits
+     past the end of B, out of the answer. */
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  head = head_mask (start);
+  tail = tail_mask (start + cnt);
+  pattern = value ? 0 : (elem_type) -1;
+  if (first == last)
+    return ((b->bits[first] ^ pattern) & head & tail) != 0;
+  return (((b->bits[first] ^ pattern) & head) != 0
+          || find_word_not (b->bits, first + 1, last, pattern) != last
+          || ((b->bits[last] ^ pattern) & tail) != 0);
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to true, and false otherwise.*/
+bool
+bitmap_any (const struct bitmap *b, size_t start, size_t cnt) 
+{
+  return bitmap_contains (b, start, cnt, true);
+}
+
+/* Returns true if no bits in B between START and START + CNT,
+   exclusive, are set to true, and false otherwise.*/
+bool
+bitmap_none (const struct bitmap *b, size_t start, size_t cnt) 
+{
+  return !bitmap_contains (b, start, cnt, true);
+}
+
+/* Returns true if every bit in B between START and START + CNT,
+   exclusive, is set to true, and false otherwise. */
+bool
+bitmap_all (const struct bitmap *b, size_t start, size_t cnt) 
+{
+  return !bitmap_contains (b, start, cnt, false);
+}
+
+/* Batches of bits.
+
+   Setting or testing thousands of scattered bits one call at a
+   time pays a cache miss for nearly every bit.  These functions
+   take a whole batch of indexes and fetch the element for each
+   index some distance ahead of using it, so that the misses
+   overlap.  Setting also gathers consecutive indexes that fall in
+   the same element into one mask, applied by a single masked
+   write followed by a single update of the summary levels and
+   rank index.  Sorting the batch first would gather more, but
+   costs more than it saves unless the batch is already nearly
+   sorted, so a batch sorted by its caller gets the most out of
+   this. */
+
+/* How many indexes ahead to prefetch the element. */
+#define BATCH_PREFETCH 8
+
+/* Sets the bits in B numbered by the CNT entries of IDX, each of
+   which must be less than the number of bits in B, to VALUE.  IDX
+   need not be sorted and may hold duplicates. */
+void
+bitmap_set_batch (struct bitmap *b, const size_t *idx, size_t cnt,
+                  bool value)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT (idx != NULL || cnt == 0);
+
+  for (i = 0; i < cnt; )
+    {
+      size_t e = elem_idx (idx[i]);
+      elem_type mask = 0;
+
+      for (; i < cnt && elem_idx (idx[i]) == e; i++)
+        {
+          ASSERT (idx[i] < b->bit_cnt);
+          mask |= bit_mask (idx[i]);
+        }
+      if (i + BATCH_PREFETCH < cnt)
+        __builtin_prefetch (&b->bits[elem_idx (idx[i + BATCH_PREFETCH])], 1);
+
+      if (b->sparse != NULL && !value && !sparse_present (b, e))
+        continue;
+      prepare_write (b, e, e);
+      set_masked (&b->bits[e], mask, value);
+      note_change (b, e, e);
+    }
+}
+
+/* Stores into RESULTS[I] the value of the bit in B numbered
+   IDX[I], for each I less than CNT, and returns the number of
+   those bits that are true.  Each entry of IDX must be less than
+   the number of bits in B. */
+size_t
+bitmap_test_batch (const struct bitmap *b, const size_t *idx, size_t cnt,
+                   bool *results)
+{
+  size_t ones = 0;
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT ((idx != NULL && results != NULL) || cnt == 0);
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (i + BATCH_PREFETCH < cnt)
+        __builtin_prefetch (&b->bits[elem_idx (idx[i + BATCH_PREFETCH])], 0);
+      results[i] = bitmap_test (b, idx[i]);
+      ones += results[i];
+    }
+  return ones;
+}
+
+/* Bit-at-a-time reference implementations.
+
+   These are the straightforward versions of bitmap_count() and
+   bitmap_contains().  They are much slower, but simple enough to
+   be obviously correct, so they are kept for checking the
+   element-at-a-time versions against. */
+
+/* Returns the number of bits in B between START and START + CNT,
+   exclusive, that are set to VALUE, testing one bit at a time. */
+size_t
+bitmap_count_ref (const struct bitmap *b, size_t start, size_t cnt,
+                  bool value) 
+{
+  size_t i, value_cnt;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  value_cnt = 0;
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to VALUE, and false otherwise, testing one
+   bit at a time. */
+bool
+bitmap_contains_ref (const struct bitmap *b, size_t start, size_t cnt,
+                     bool value) 
+{
+  size_t i;
+  
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+/* Finding set or unset bits. */
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE.
+   If there is no such group, returns BITMAP_ERROR. */
+size_t
+bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+  return scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B between START and END, exclusive, that
+   are all set to VALUE.  Bits at or after END are neither
+   examined nor included in the group.
+   If there is no such group, returns BITMAP_ERROR.
+   If CNT is zero, returns START. */
+size_t
+bitmap_scan_range (const struct bitmap *b, size_t start, size_t end,
+                   size_t cnt, bool value)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= end);
+  ASSERT (end <= b->bit_cnt);
+
+  if (cnt == 0)
+    return start;
+  return scan_range (b, start, end, cnt, value);
+}
+
+/* Finds the first group of CNT consecutive bits in B at or after
+   START that are all set to VALUE, flips them all to !VALUE,
+   and returns the index of the first bit in the group.
+   If there is no such group, returns BITMAP_ERROR.
+   If CNT is zero, returns 0.
+   Bits are set atomically, but testing bits is not atomic with
+   setting them. */
+size_t
+bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx = bitmap_scan (b, start, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    bitmap_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to true, or BITMAP_ERROR if there is none.  START may
+   be bitmap_size (B), in which case BITMAP_ERROR is returned.
+   See bitmap_for_each_set_bit() for a loop built on this. */
+size_t
+bitmap_next_set (const struct bitmap *b, size_t start)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  return next_bit (b, start, true);
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to false, or BITMAP_ERROR if there is none.  START may
+   be bitmap_size (B), in which case BITMAP_ERROR is returned. */
+size_t
+bitmap_next_clear (const struct bitmap *b, size_t start)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  return next_bit (b, start, false);
+}
+
+/* Returns the start of the smallest run of at least CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE, or BITMAP_ERROR if there is none.  B's run index is
+   used if it has one.  Otherwise runs are found with next_bit(),
+   which jumps over whole elements, and the search stops early at
+   a run of exactly CNT bits. */
+static size_t
+best_fit (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t best = BITMAP_ERROR, best_len = SIZE_MAX;
+  size_t idx = start;
+
+  if (b->runs != NULL)
+    return runs_best_fit (b, start, cnt, value);
+
+  while (idx < b->bit_cnt)
+    {
+      size_t run_start = next_bit (b, idx, value);
+      size_t run_end, run_len;
+
+      if (run_start == BITMAP_ERROR)
+        break;
+      run_end = next_bit (b, run_start, !value);
+      if (run_end == BITMAP_ERROR)
+        run_end = b->bit_cnt;
+
+      run_len = run_end - run_start;
+      if (run_len >= cnt && run_len < best_len)
+        {
+          best = run_start;
+          best_len = run_len;
+          if (run_len == cnt)
+            break;
+        }
+      idx = run_end;
+    }
+  return best;
+}
+
+/* Finds and returns the starting index of a group of CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE, choosing among the candidates according to POLICY:
+
+      - BITMAP_FIRST_FIT takes the first group, like
+        bitmap_scan().
+
+      - BITMAP_NEXT_FIT takes the first group at or after B's
+        rotor, wrapping around to START if there is none, and
+        then moves the rotor just past the group.  Successive
+        scans thus spread out over B instead of rescanning the
+        busy low indexes every time.
+
+      - BITMAP_BEST_FIT takes the start of the smallest run of
+        VALUE bits that holds CNT bits, which leaves large runs
+        intact for large requests.  Without a run index (see
+        bitmap_enable_runs()) this visits every run.
+
+   If there is no such group, returns BITMAP_ERROR.  If CNT is
+   zero, returns START.  Like bitmap_scan(), this does not
+   modify the bits of B. */
+size_t
+bitmap_scan_policy (struct bitmap *b, size_t start, size_t cnt, bool value,
+                    enum bitmap_policy policy)
+{
+  size_t rotor, idx;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  switch (policy)
+    {
+    case BITMAP_FIRST_FIT:
+      return scan_range (b, start, b->bit_cnt, cnt, value);
+    case BITMAP_NEXT_FIT:
+      rotor = b->rotor;
+      if (rotor < start || rotor >= b->bit_cnt)
+        rotor = start;
+      idx = scan_range (b, rotor, b->bit_cnt, cnt, value);
+      if (idx == BITMAP_ERROR && rotor > start)
+        {
+          /* Groups that start before the rotor may run past it. */
+          size_t end = rotor + cnt - 1;
+          idx = scan_range (b, start, end < b->bit_cnt ? end : b->bit_cnt,
+                            cnt, value);
+        }
+      if (idx != BITMAP_ERROR)
+        b->rotor = idx + cnt;
+      return idx;
+    default:
+      return best_fit (b, start, cnt, value);
+    }
+}
+
+/* Statistics. */
+
+/* Adds a finished run of LEN false bits, which may be 0, to
+   STATS. */
+static void
+stats_end_run (struct bitmap_stats *stats, size_t len)
+{
+  int bucket;
+
+  if (len == 0)
+    return;
+  bucket = (int) (sizeof len * CHAR_BIT) - 1 - __builtin_clzl (len);
+  if (bucket >= BITMAP_STATS_BUCKETS)
+    bucket = BITMAP_STATS_BUCKETS - 1;
+  stats->free_run_cnt++;
+  stats->free_run_hist[bucket]++;
+  if (len > stats->largest_free_run)
+    stats->largest_free_run = len;
+}
+
+/* Adds the 1 bits of E, which holds bits BASE through BASE +
+   ELEM_BITS - 1 of a bitmap, to the counts in REGION_SET of the
+   REGION_BITS-bit regions they fall in. */
+static void
+stats_count_regions (elem_type e, size_t base, size_t region_bits,
+                     size_t *region_set)
+{
+  size_t bit = base;
+
+  while (e != 0)
+    {
+      size_t region = bit / region_bits;
+      size_t region_end = (region + 1) * region_bits;
+
+      if (region_end - base >= ELEM_BITS)
+        {
+          region_set[region] += popcount (e);
+          return;
+        }
+      region_set[region] += popcount (e & tail_mask (region_end));
+      e &= ~tail_mask (region_end);
+      bit = region_end;
+    }
+}
+
+/* Computes statistics on how the bits of B are filled and stores
+   them in *STATS.  If REGION_SET is nonnull, B is also divided
+   into regions of REGION_BITS bits each, which must be nonzero,
+   and REGION_SET[I] is set to the number of true bits in region
+   I, so that it must have room for one entry per region, the
+   last of which may be partial.
+
+   All of this is gathered in a single pass over B an element at
+   a time, with runs of false bits split out of mixed elements
+   with ctz() as in scan_range(), so that monitoring the
+   fragmentation of an allocator's free map costs about as much
+   as one bitmap_count() rather than a bitmap_scan() for each run
+   length of interest.  The absent pages of a sparse bitmap are
+   not read. */
+void
+bitmap_stats (const struct bitmap *b, struct bitmap_stats *stats,
+              size_t region_bits, size_t *region_set)
+{
+  size_t elems = elem_cnt (b->bit_cnt);
+  size_t run_len = 0;
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT (stats != NULL);
+  ASSERT (region_set == NULL || region_bits > 0);
+
+  memset (stats, 0, sizeof *stats);
+  if (region_set != NULL)
+    memset (region_set, 0,
+            DIV_ROUND_UP (b->bit_cnt, region_bits) * sizeof *region_set);
+
+  for (i = 0; i < elems; i++)
+    {
+      size_t base = i * ELEM_BITS;
+      size_t valid = b->bit_cnt - base < ELEM_BITS ? b->bit_cnt - base
+                                                   : ELEM_BITS;
+      size_t bit;
+      elem_type e;
+
+      if (b->sparse != NULL)
+        {
+          /* Absent pages hold nothing but false bits. */
+          size_t stop = sparse_skip (b, i, elems);
+
+          if (stop > i)
+            {
+              size_t end = stop * ELEM_BITS;
+
+              run_len += (end < b->bit_cnt ? end : b->bit_cnt) - base;
+              i = stop - 1;
+              continue;
+            }
+        }
+
+      e = b->bits[i];
+      if (e == 0)
+        {
+          run_len += valid;
+          continue;
+        }
+      stats->set_cnt += popcount (e);
+      if (region_set != NULL)
+        stats_count_regions (e, base, region_bits, region_set);
+
+      /* Split E into runs.  The unused bits past the end of B are
+         0, so they never start a run of 1 bits. */
+      for (bit = 0; bit < valid; )
+        {
+          elem_type rest = e >> bit;
+          size_t zeros, ones;
+
+          if (rest == 0)
+            {
+              run_len += valid - bit;
+              break;
+            }
+          zeros = ctz (rest);
+          run_len += zeros;
+          stats_end_run (stats, run_len);
+          run_len = 0;
+
+          /* E >> BIT has 0 bits shifted in at the top unless BIT
+             is 0, so its complement is nonzero unless E is all
+             1s. */
+          bit += zeros;
+          rest = ~(e >> bit);
+          ones = rest != 0 ? ctz (rest) : ELEM_BITS;
+          bit += ones;
+        }
+    }
+  stats_end_run (stats, run_len);
+  stats->clear_cnt = b->bit_cnt - stats->set_cnt;
+}
+
+/* Combining bitmaps.
+
+   These functions combine two bitmaps A and B of the same size
+   bit by bit.  The ones that store a result take a destination
+   DST of the same size, which may be A or B itself for the
+   in-place form, e.g. bitmap_and (a, a, b) for A &= B.  The
+   counting ones return the number of 1 bits the result would
+   have without storing it. */
+
+/* Stores A combined with B according to OP into DST. */
+static void
+combine_bitmaps (struct bitmap *dst, const struct bitmap *a,
+                 const struct bitmap *b, enum combine_op op)
+{
+  ASSERT (dst != NULL && a != NULL && b != NULL);
+  ASSERT (a->bit_cnt == b->bit_cnt);
+  ASSERT (dst->bit_cnt == a->bit_cnt);
+
+  /* Unused bits past the end are 0 in A and B, so they stay 0 in
+     DST under every OP. */
+  if (dst->bit_cnt > 0)
+    prepare_write (dst, 0, elem_cnt (dst->bit_cnt) - 1);
+  combine_words (dst->bits, a->bits, b->bits, elem_cnt (a->bit_cnt), op);
+  note_change (dst, 0, elem_cnt (dst->bit_cnt) - 1);
+}
+
+/* Returns the number of 1 bits in A combined with B according
+   to OP. */
+static size_t
+count_combined (const struct bitmap *a, const struct bitmap *b,
+                enum combine_op op)
+{
+  ASSERT (a != NULL && b != NULL);
+  ASSERT (a->bit_cnt == b->bit_cnt);
+
+  return combine_count_words (a->bits, b->bits, elem_cnt (a->bit_cnt), op);
+}
+
+/* Sets DST to A & B. */
+void
+bitmap_and (struct bitmap *dst, const struct bitmap *a,
+            const struct bitmap *b)
+{
+  combine_bitmaps (dst, a, b, COMBINE_AND);
+}
+
+/* Sets DST to A | B. */
+void
+bitmap_or (struct bitmap *dst, const struct bitmap *a,
+           const struct bitmap *b)
+{
+  combine_bitmaps (dst, a, b, COMBINE_OR);
+}
+
+/* Sets DST to A ^ B. */
+void
+bitmap_xor (struct bitmap *dst, const struct bitmap *a,
+            const struct bitmap *b)
+{
+  combine_bitmaps (dst, a, b, COMBINE_XOR);
+}
+
+/* Sets DST to A & ~B, that is, to the bits of A not in B. */
+void
+bitmap_andnot (struct bitmap *dst, const struct bitmap *a,
+               const struct bitmap *b)
+{
+  combine_bitmaps (dst, a, b, COMBINE_ANDNOT);
+}
+
+/* Returns the number of bits set in A & B. */
+size_t
+bitmap_and_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return count_combined (a, b, COMBINE_AND);
+}
+
+/* Returns the number of bits set in A | B. */
+size_t
+bitmap_or_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return count_combined (a, b, COMBINE_OR);
+}
+
+/* Returns the number of bits set in A ^ B. */
+size_t
+bitmap_xor_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return count_combined (a, b, COMBINE_XOR);
+}
+
+/* Returns the number of bits set in A & ~B. */
+size_t
+bitmap_andnot_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return count_combined (a, b, COMBINE_ANDNOT);
+}
+
+/* Multiprocessor-safe operations.
+
+   These functions may be called on the same bitmap from any
+   number of threads at once.  Each one updates a whole element
+   with a single C11 atomic read-modify-write, so unlike
+   bitmap_mark() and friends they are safe on a multiprocessor.
+   They do not maintain the summary levels or the rank index,
+   copy pages for snapshots, or track the pages of a sparse
+   bitmap, so B must have none of those. */
+
+/* Returns element IDX of B as an atomic object. */
+static inline _Atomic elem_type *
+atomic_elem (const struct bitmap *b, size_t idx)
+{
+  return (_Atomic elem_type *) &b->bits[idx];
+}
+
+/* Atomically sets the bit numbered IDX in B to true and returns
+   its previous value. */
+bool
+bitmap_atomic_mark (struct bitmap *b, size_t idx)
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+  ASSERT (b->summary == NULL);
+  ASSERT (b->rank == NULL);
+  ASSERT (b->runs == NULL);
+  ASSERT (b->sparse == NULL);
+  ASSERT (!has_snapshots (b));
+
+  return (atomic_fetch_or (atomic_elem (b, elem_idx (idx)), bit_mask (idx))
+          & bit_mask (idx)) != 0;
+}
+
+/* Atomically sets the bit numbered IDX in B to false and returns
+   its previous value. */
+bool
+bitmap_atomic_reset (struct bitmap *b, size_t idx)
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+  ASSERT (b->summary == NULL);
+  ASSERT (b->rank == NULL);
+  ASSERT (b->runs == NULL);
+  ASSERT (b->sparse == NULL);
+  ASSERT (!has_snapshots (b));
+
+  return (atomic_fetch_and (atomic_elem (b, elem_idx (idx)), ~bit_mask (idx))
+          & bit_mask (idx)) != 0;
+}
+
+/* Atomically toggles the bit numbered IDX in B and returns its
+   previous value. */
+bool
+bitmap_atomic_flip (struct bitmap *b, size_t idx)
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+  ASSERT (b->summary == NULL);
+  ASSERT (b->rank == NULL);
+  ASSERT (b->runs == NULL);
+  ASSERT (b->sparse == NULL);
+  ASSERT (!has_snapshots (b));
+
+  return (atomic_fetch_xor (atomic_elem (b, elem_idx (idx)), bit_mask (idx))
+          & bit_mask (idx)) != 0;
+}
+
+/* Returns the value of the bit numbered IDX in B, read
+   atomically. */
+bool
+bitmap_atomic_test (const struct bitmap *b, size_t idx)
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+
+  return (atomic_load (atomic_elem (b, elem_idx (idx))) & bit_mask (idx)) != 0;
+}
+
+/* Atomically flips the bits selected by MASK in element IDX of B
+   if all of them are currently set to VALUE.  Returns true if
+   successful, false if any of them is already !VALUE.  Other
+   bits in the element may change concurrently; that only makes
+   the compare-and-swap retry. */
+static bool
+claim_elem (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  _Atomic elem_type *e = atomic_elem (b, idx);
+  elem_type old = atomic_load (e);
+
+  do
+    if (((value ? old : ~old) & mask) != mask)
+      return false;
+  while (!atomic_compare_exchange_weak (e, &old, old ^ mask));
+  return true;
+}
+
+/* Atomically flips the CNT bits starting at START in B from
+   VALUE to !VALUE, one element at a time.  If some element's
+   bits are no longer all VALUE, restores the elements already
+   flipped and returns false.  Returns true if every element was
+   flipped. */
+static bool
+claim_range (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t first = elem_idx (start);
+  size_t last = elem_idx (start + cnt - 1);
+  size_t i;
+
+  for (i = first; i <= last; i++)
+    {
+      elem_type mask = (elem_type) -1;
+      if (i == first)
+        mask &= head_mask (start);
+      if (i == last)
+        mask &= tail_mask (start + cnt);
+
+      if (!claim_elem (b, i, mask, value))
+        {
+          /* Give back what we took.  Nobody else can have
+             claimed those bits in the meantime, because they
+             were !VALUE all along. */
+          while (i-- > first)
+            {
+              mask = (elem_type) -1;
+              if (i == first)
+                mask &= head_mask (start);
+              atomic_fetch_xor (atomic_elem (b, i), mask);
+            }
+          return false;
+        }
+    }
+  return true;
+}
+
+/* Finds the first group of CNT consecutive bits in B at or after
+   START that are all set to VALUE, atomically flips them all to
+   !VALUE, and returns the index of the first bit in the group.
+   If there is no such group, returns BITMAP_ERROR.  If CNT is
+   zero, returns START.
+
+   This is lock-free: the search itself uses plain loads and may
+   see a stale picture of B, but every element of a candidate
+   group is then claimed with compare-and-swap.  If another
+   thread got to any of its bits first, the partial claim is
+   undone and the search resumes at the same candidate. */
+size_t
+bitmap_atomic_scan_and_flip (struct bitmap *b, size_t start, size_t cnt,
+                             bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+  ASSERT (b->summary == NULL);
+  ASSERT (b->rank == NULL);
+  ASSERT (b->runs == NULL);
+  ASSERT (b->sparse == NULL);
+  ASSERT (!has_snapshots (b));
+
+  if (cnt == 0)
+    return bitmap_scan (b, start, cnt, value);
+  for (idx = start; ; )
+    {
+      idx = bitmap_scan (b, idx, cnt, value);
+      if (idx == BITMAP_ERROR || claim_range (b, idx, cnt, value))
+        return idx;
+    }
+}
+
+/* Summary levels. */
+
+/* Adds a summary of uniform elements to B, which speeds up
+   bitmap_scan() and bitmap_scan_and_flip() on large bitmaps in
+   which the runs being searched for are rare, at the cost of
+   about 3% more memory and of keeping the summary up to date in
+   every function that modifies B.  Returns true if successful,
+   false if memory allocation failed.  Does nothing if B already
+   has a summary. */
+bool
+bitmap_enable_summary (struct bitmap *b)
+{
+  struct bitmap_summary *s;
+  int v;
+
+  ASSERT (b != NULL);
+
+  if (b->summary != NULL)
+    return true;
+  if (b->bit_cnt == 0)
+    return false;
+
+  s = calloc (1, sizeof *s);
+  if (s == NULL)
+    return false;
+  s->level1_cnt = elem_cnt (elem_cnt (b->bit_cnt));
+  s->level2_cnt = elem_cnt (s->level1_cnt);
+  for (v = 0; v < 2; v++)
+    {
+      s->level1[v] = malloc (s->level1_cnt * sizeof (elem_type));
+      s->level2[v] = malloc (s->level2_cnt * sizeof (elem_type));
+      if (s->level1[v] == NULL || s->level2[v] == NULL)
+        {
+          b->summary = s;
+          bitmap_disable_summary (b);
+          return false;
+        }
+
+      /* Start out with every bit set so that the bits past the
+         end stay set; summary_update() fixes the rest. */
+      memset (s->level1[v], 0xff, s->level1_cnt * sizeof (elem_type));
+      memset (s->level2[v], 0xff, s->level2_cnt * sizeof (elem_type));
+    }
+
+  b->summary = s;
+  summary_update (b, 0, elem_cnt (b->bit_cnt) - 1);
+  return true;
+}
+
+/* Removes the summary from B, if it has one, and frees it. */
+void
+bitmap_disable_summary (struct bitmap *b)
+{
+  struct bitmap_summary *s = b->summary;
+  int v;
+
+  if (s != NULL)
+    {
+      for (v = 0; v < 2; v++)
+        {
+          free (s->level1[v]);
+          free (s->level2[v]);
+        }
+      free (s);
+      b->summary = NULL;
+    }
+}
+
+/* Snapshots. */
+
+/* Takes a snapshot of B and returns it, or returns a null pointer
+   on failure.  The snapshot is a bitmap with B's current size
+   and contents that can be passed to any function that does not
+   modify its bitmap, until it is destroyed with
+   bitmap_destroy().  It must not be modified.
+
+   Taking a snapshot copies none of B's bits, only one bit per
+   page of them: the snapshot shares B's pages, and a page is
+   copied for the snapshot when B first writes to it afterward.
+   B may be destroyed before its snapshots.  B must have been
+   created by bitmap_create(); the first snapshot moves its bits
+   into a memory file, once. */
+struct bitmap *
+bitmap_snapshot (struct bitmap *b)
+{
+  struct bitmap_cow *c;
+  struct bitmap *s;
+  size_t size, pages;
+
+  ASSERT (b != NULL);
+  ASSERT (b->sparse == NULL);
+
+  if (b->cow == NULL && !cow_start (b))
+    return NULL;
+  ASSERT (b->cow->fd >= 0);     /* Not a snapshot of a snapshot. */
+
+  s = malloc (sizeof *s);
+  c = calloc (1, sizeof *c);
+  size = cow_map_size (b->bit_cnt);
+  pages = size / page_size ();
+  if (s == NULL || c == NULL)
+    goto error;
+  c->shared = bitmap_create (pages);
+  if (c->shared == NULL)
+    goto error;
+  s->bits = mmap (NULL, size, PROT_READ, MAP_SHARED, b->cow->fd, 0);
+  if (s->bits == MAP_FAILED)
+    goto error;
+
+  bitmap_set_all (c->shared, true);
+  bitmap_set_multiple (b->cow->shared, 0, pages, true);
+  c->fd = -1;
+  c->map_size = size;
+  c->live = b;
+  c->next = b->cow->next;
+  b->cow->next = s;
+
+  s->bit_cnt = b->bit_cnt;
+  s->elem_cap = elem_cnt (b->bit_cnt);
+  s->summary = NULL;
+  s->rank = NULL;
+  s->runs = NULL;
+  s->rotor = 0;
+  s->cow = c;
+  s->sparse = NULL;
+  s->owns_bits = false;
+  return s;
+
+ error:
+  if (c != NULL)
+    bitmap_destroy (c->shared);
+  free (c);
+  free (s);
+  return NULL;
+}
+
+/* Rank and select. */
+
+/* Adds a rank and select index to B, which makes bitmap_rank()
+   take constant time and bitmap_select() nearly so, at the cost
+   of about 3.5% more memory.  The index is built lazily by the
+   first queries that need it, and modifying B makes only the
+   part of it past the modification stale, so it suits bitmaps
+   that change slowly.  Returns true if successful, false if
+   memory allocation failed.  Does nothing if B already has an
+   index. */
+bool
+bitmap_enable_rank (struct bitmap *b)
+{
+  struct bitmap_rank *r;
+
+  ASSERT (b != NULL);
+
+  if (b->rank != NULL)
+    return true;
+
+  r = calloc (1, sizeof *r);
+  if (r == NULL)
+    return false;
+  r->super_cnt = DIV_ROUND_UP (elem_cnt (b->bit_cnt), RANK_SUPER_ELEMS);
+  r->super = malloc ((r->super_cnt + 1) * sizeof *r->super);
+  r->block = malloc (r->super_cnt * RANK_BLOCKS * sizeof *r->block);
+  b->rank = r;
+  if (r->super == NULL || (r->block == NULL && r->super_cnt > 0))
+    {
+      bitmap_disable_rank (b);
+      return false;
+    }
+  r->super[0] = 0;
+  return true;
+}
+
+/* Removes the rank and select index from B, if it has one, and
+   frees it. */
+void
+bitmap_disable_rank (struct bitmap *b)
+{
+  struct bitmap_rank *r = b->rank;
+
+  if (r != NULL)
+    {
+      free (r->super);
+      free (r->block);
+      free (r->samples);
+      free (r);
+      b->rank = NULL;
+    }
+}
+
+/* Returns the number of bits in B before index IDX that are set
+   to true.  IDX may be bitmap_size (B), giving the number of
+   true bits in all of B.  Without a rank index, this counts the
+   bits one element at a time. */
+size_t
+bitmap_rank (const struct bitmap *b, size_t idx)
+{
+  struct bitmap_rank *r;
+  size_t e, s, cnt, i;
+
+  ASSERT (b != NULL);
+  ASSERT (idx <= b->bit_cnt);
+
+  r = b->rank;
+  if (r == NULL)
+    return bitmap_count (b, 0, idx, true);
+  if (idx == b->bit_cnt)
+    {
+      rank_build (b, r->super_cnt);
+      return r->super[r->super_cnt];
+    }
+
+  e = elem_idx (idx);
+  s = e / RANK_SUPER_ELEMS;
+  rank_build (b, s + 1);
+  cnt = r->super[s] + r->block[e / RANK_BLOCK_ELEMS];
+  for (i = ROUND_DOWN (e, RANK_BLOCK_ELEMS); i < e; i++)
+    cnt += popcount (b->bits[i]);
+  return cnt + popcount (b->bits[e] & (bit_mask (idx) - 1));
+}
+
+/* Returns the index of the bit in B that is set to true and has
+   exactly K true bits before it, that is, the index of the
+   (K + 1)th true bit.  Returns BITMAP_ERROR if B has K or fewer
+   true bits.  Without a rank index, this scans B one element at
+   a time. */
+size_t
+bitmap_select (const struct bitmap *b, size_t k)
+{
+  struct bitmap_rank *r;
+  size_t lo, hi, blk, blk_end;
+
+  ASSERT (b != NULL);
+
+  r = b->rank;
+  if (r == NULL)
+    return select_from (b, 0, k);
+  rank_build (b, r->super_cnt);
+  if (k >= r->super[r->super_cnt])
+    return BITMAP_ERROR;
+
+  /* Find the superblock S that holds the bit: the last one with
+     SUPER[S] <= K.  The samples narrow the search down to the
+     superblocks between two samples. */
+  lo = 0;
+  hi = r->super_cnt;
+  if (r->sample_cnt != 0 || rank_sample (r))
+    {
+      size_t j = k / SELECT_SAMPLE;
+      lo = r->samples[j];
+      if (j + 1 < r->sample_cnt)
+        hi = r->samples[j + 1] + 1;
+    }
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (r->super[mid] <= k)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  k -= r->super[lo];
+
+  /* Then the block within the superblock. */
+  blk = lo * RANK_BLOCKS;
+  blk_end = DIV_ROUND_UP (elem_cnt (b->bit_cnt), RANK_BLOCK_ELEMS);
+  if (blk_end > blk + RANK_BLOCKS)
+    blk_end = blk + RANK_BLOCKS;
+  while (blk + 1 < blk_end && r->block[blk + 1] <= k)
+    blk++;
+  k -= r->block[blk];
+
+  return select_from (b, blk * RANK_BLOCK_ELEMS, k);
+}
+
+/* Run index. */
+
+/* Adds a run index to B, which makes bitmap_scan_policy() with
+   BITMAP_BEST_FIT find the smallest fitting run in logarithmic
+   time instead of visiting every run.  The index takes about 64
+   bytes per run of B, so it suits bitmaps whose bits come in long
+   runs, such as allocation maps, and it is kept up to date in
+   every function that modifies B, at a cost proportional to the
+   number of bits modified.  Returns true if successful, false if
+   memory allocation failed.  Does nothing if B already has an
+   index. */
+bool
+bitmap_enable_runs (struct bitmap *b)
+{
+  struct bitmap_runs *x;
+
+  ASSERT (b != NULL);
+
+  if (b->runs != NULL)
+    return true;
+
+  x = calloc (1, sizeof *x);
+  if (x == NULL)
+    return false;
+  x->seed = 2463534242u;
+  b->runs = x;
+  runs_update (b, 0, 0, b->bit_cnt);
+  return b->runs != NULL;
+}
+
+/* Removes the run index from B, if it has one, and frees it. */
+void
+bitmap_disable_runs (struct bitmap *b)
+{
+  struct bitmap_runs *x = b->runs;
+
+  if (x != NULL)
+    {
+      run_free_all (x->by_start);
+      free (x);
+      b->runs = NULL;
+    }
+}
+
+/* Returns the number of bytes needed to store B in a file. */
+size_t
+bitmap_file_size (const struct bitmap *b) 
+{
+  return byte_cnt (b->bit_cnt);
+}
+
+/* Header at the start of a bitmap file.
+
+   A bitmap file has the same layout as a buffer passed to
+   bitmap_create_in_buf(), except that this header, which holds
+   no pointers, takes the place of struct bitmap.  The elements
+   follow it directly, bitmap_file_size() bytes of them. */
+struct bitmap_file_header
+  {
+    uint32_t magic;             /* BITMAP_FILE_MAGIC. */
+    uint16_t version;           /* BITMAP_FILE_VERSION. */
+    uint16_t elem_size;         /* sizeof (elem_type). */
+    uint64_t bit_cnt;           /* Number of bits. */
+  };
+
+#define BITMAP_FILE_MAGIC 0x50414d42u   /* "BMAP" in little-endian. */
+#define BITMAP_FILE_VERSION 1
+
+/* Returns the size of the mapping behind a file-backed bitmap of
+   BIT_CNT bits. */
+static size_t
+map_size (size_t bit_cnt)
+{
+  return sizeof (struct bitmap_file_header) + byte_cnt (bit_cnt);
+}
+
+/* Opens the bitmap file PATH, creating it if it does not exist,
+   and returns a bitmap whose bits live in a shared mapping of
+   the file, so that every change to the bitmap is a change to
+   the file.  Opening does not read the bits, so it takes the
+   same time however large the bitmap is.
+
+   A new file is created with BIT_CNT bits, all set to false.
+   An existing file must have a valid header for BIT_CNT bits;
+   if BIT_CNT is 0, the size recorded in the file is used
+   instead.  Returns a null pointer if the file cannot be opened,
+   created, or mapped, or if its header does not match.
+
+   Changes reach the disk at the operating system's leisure, or
+   when bitmap_sync() is called.  The bitmap must be closed with
+   bitmap_close_mmap(), not bitmap_destroy().  It cannot be
+   resized, since its size is fixed by the file's header and
+   mapping: bitmap_expand() and bitmap_shrink() return a null
+   pointer for it. */
+struct bitmap *
+bitmap_open_mmap (const char *path, size_t bit_cnt)
+{
+  static const struct bitmap_file_header blank;
+  struct bitmap_file_header stored;
+  struct bitmap *b;
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open (path, O_RDWR | O_CREAT, 0666);
+  if (fd < 0)
+    return NULL;
+  if (fstat (fd, &st) < 0)
+    goto error;
+
+  /* A file of the right size whose header is all zeros was being
+     created when the system crashed, before its header reached
+     the disk, so it is created again. */
+  if (st.st_size == 0
+      || (bit_cnt != 0
+          && (size_t) st.st_size == map_size (bit_cnt)
+          && pread (fd, &stored, sizeof stored, 0) == sizeof stored
+          && !memcmp (&stored, &blank, sizeof stored)))
+    {
+      /* New file.  ftruncate() fills it with zeros, which is an
+         all-false bitmap, so only the header needs writing.  It
+         is written through the file rather than the mapping and
+         forced to disk, so that the file is valid from here on
+         even if the bitmap is never synced. */
+      stored.magic = BITMAP_FILE_MAGIC;
+      stored.version = BITMAP_FILE_VERSION;
+      stored.elem_size = sizeof (elem_type);
+      stored.bit_cnt = bit_cnt;
+      if (ftruncate (fd, map_size (bit_cnt)) < 0
+          || pwrite (fd, &stored, sizeof stored, 0) != sizeof stored
+          || fsync (fd) < 0)
+        goto error;
+    }
+  else
+    {
+      if ((size_t) st.st_size < sizeof stored
+          || pread (fd, &stored, sizeof stored, 0) != sizeof stored
+          || stored.magic != BITMAP_FILE_MAGIC
+          || stored.version != BITMAP_FILE_VERSION
+          || stored.elem_size != sizeof (elem_type)
+          || (bit_cnt != 0 && stored.bit_cnt != bit_cnt)
+          || (size_t) st.st_size != map_size (stored.bit_cnt))
+        goto error;
+      bit_cnt = stored.bit_cnt;
+    }
+
+  map = mmap (NULL, map_size (bit_cnt), PROT_READ | PROT_WRITE, MAP_SHARED,
+              fd, 0);
+  if (map == MAP_FAILED)
+    goto error;
+  close (fd);
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    {
+      munmap (map, map_size (bit_cnt));
+      return NULL;
+    }
+
+  b->bit_cnt = bit_cnt;
+  b->elem_cap = elem_cnt (bit_cnt);
+  b->bits = (elem_type *) ((struct bitmap_file_header *) map + 1);
+  b->summary = NULL;
+  b->rank = NULL;
+  b->runs = NULL;
+  b->rotor = 0;
+  b->cow = NULL;
+  b->sparse = NULL;
+  b->owns_bits = false;
+  return b;
+
+ error:
+  close (fd);
+  return NULL;
+}
+
+/* Writes any changes to file-backed bitmap B out to its file and
+   waits for them to reach the disk, making a checkpoint that
+   survives a crash.  Returns true if successful, false on I/O
+   error. */
+bool
+bitmap_sync (struct bitmap *b)
+{
+  ASSERT (b != NULL);
+
+  return msync ((struct bitmap_file_header *) b->bits - 1,
+                map_size (b->bit_cnt), MS_SYNC) == 0;
+}
+
+/* Unmaps file-backed bitmap B and frees it.  Changes not yet
+   written out by bitmap_sync() still reach the file eventually,
+   unless the system crashes first. */
+void
+bitmap_close_mmap (struct bitmap *b)
+{
+  if (b != NULL)
+    {
+      bitmap_disable_summary (b);
+      bitmap_disable_rank (b);
+      bitmap_disable_runs (b);
+      munmap ((struct bitmap_file_header *) b->bits - 1,
+              map_size (b->bit_cnt));
+      free (b);
+    }
+}
+
+/* Serialization.
+
+   A bitmap can be encoded in three formats, each covering just
+   the bitmap's bits, in order from bit 0:
+
+      - BITMAP_BINARY: one '0' or '1' character per bit, as
+        printed by testlib's dumpdata command.
+
+      - BITMAP_HEX: two lowercase hexadecimal digits per byte of
+        the bitmap, as printed by bitmap_dump(), so bits 0...7
+        are the first two digits.  The last byte is padded with
+        0 bits.
+
+      - BITMAP_RAW: the bytes themselves, that is, the elements
+        in little-endian byte order.  The last byte is padded
+        with 0 bits.
+
+   The encoders work a byte of the bitmap at a time, through
+   lookup tables, into a single buffer. */
+
+/* BINARY_DIGITS[X] holds the 8 binary digits for byte X, lowest
+   bit first, as 8 characters.  HEX_DIGITS[X] holds the 2 hex
+   digits. */
+static uint64_t binary_digits[256];
+static uint16_t hex_digits[256];
+
+/* Fills in binary_digits[] and hex_digits[], if that has not
+   been done yet. */
+static void
+init_digits (void)
+{
+  static const char hex[] = "0123456789abcdef";
+  int x, i;
+
+  if (binary_digits[0] != 0)
+    return;
+  for (x = 0; x < 256; x++)
+    {
+      char *bin = (char *) &binary_digits[x];
+      char *h = (char *) &hex_digits[x];
+
+      for (i = 0; i < 8; i++)
+        bin[i] = '0' + ((x >> i) & 1);
+      h[0] = hex[x >> 4];
+      h[1] = hex[x & 15];
+    }
+}
+
+/* Returns the value of hex digit C, or -1 if C is not one. */
+static int
+hex_value (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  else if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  else
+    return -1;
+}
+
+/* Returns the number of bytes in the encoding of B in FORMAT. */
+size_t
+bitmap_encoded_size (const struct bitmap *b, enum bitmap_format format)
+{
+  size_t bytes = DIV_ROUND_UP (b->bit_cnt, CHAR_BIT);
+
+  switch (format)
+    {
+    case BITMAP_BINARY:
+      return b->bit_cnt;
+    case BITMAP_HEX:
+      return bytes * 2;
+    default:
+      return bytes;
+    }
+}
+
+/* Encodes B in FORMAT into BUF, which must have room for
+   bitmap_encoded_size (B, FORMAT) bytes, and returns the number
+   of bytes written.  No null terminator is added. */
+size_t
+bitmap_encode (const struct bitmap *b, enum bitmap_format format, void *buf_)
+{
+  const uint8_t *bytes = (const uint8_t *) b->bits;
+  size_t byte_cnt = DIV_ROUND_UP (b->bit_cnt, CHAR_BIT);
+  size_t whole = b->bit_cnt / CHAR_BIT;
+  char *buf = buf_;
+  size_t i;
+
+  ASSERT (b != NULL);
+
+  init_digits ();
+  switch (format)
+    {
+    case BITMAP_BINARY:
+      for (i = 0; i < whole; i++)
+        memcpy (buf + i * CHAR_BIT, &binary_digits[bytes[i]], CHAR_BIT);
+      for (i = whole * CHAR_BIT; i < b->bit_cnt; i++)
+        buf[i] = bitmap_test (b, i) ? '1' : '0';
+      break;
+    case BITMAP_HEX:
+      for (i = 0; i < byte_cnt; i++)
+        memcpy (buf + i * 2, &hex_digits[bytes[i]], 2);
+      break;
+    default:
+      memcpy (buf, bytes, byte_cnt);
+      break;
+    }
+  return bitmap_encoded_size (b, format);
+}
+
+/* Writes B to FILE, encoded in FORMAT, with a single fwrite().
+   Returns true if successful, false if memory allocation failed
+   or on write error. */
+bool
+bitmap_write (const struct bitmap *b, enum bitmap_format format, FILE *file)
+{
+  size_t size = bitmap_encoded_size (b, format);
+  bool ok;
+  char *buf;
+
+  if (size == 0)
+    return true;
+  buf = malloc (size);
+  if (buf == NULL)
+    return false;
+  bitmap_encode (b, format, buf);
+  ok = fwrite (buf, 1, size, file) == size;
+  free (buf);
+  return ok;
+}
+
+/* Creates and returns a bitmap of BIT_CNT bits decoded from the
+   SIZE bytes in BUF, which must be exactly the encoding of such
+   a bitmap in FORMAT.  Padding bits in the last byte are
+   ignored.  Returns a null pointer if BUF is not a valid
+   encoding or memory allocation failed. */
+struct bitmap *
+bitmap_decode (const void *buf_, size_t size, size_t bit_cnt,
+               enum bitmap_format format)
+{
+  const char *buf = buf_;
+  size_t byte_cnt = DIV_ROUND_UP (bit_cnt, CHAR_BIT);
+  struct bitmap *b;
+  uint8_t *bytes;
+  size_t i;
+
+  b = bitmap_create (bit_cnt);
+  if (b == NULL)
+    return NULL;
+  if (size != bitmap_encoded_size (b, format))
+    goto error;
+
+  bytes = (uint8_t *) b->bits;
+  switch (format)
+    {
+    case BITMAP_BINARY:
+      for (i = 0; i + CHAR_BIT <= size; i += CHAR_BIT)
+        {
+          /* Subtracting '0' from each of 8 digits at once leaves
+             0 or 1 in every byte, and the multiplication gathers
+             those into the top byte, the first digit lowest. */
+          uint64_t digits;
+          memcpy (&digits, buf + i, sizeof digits);
+          digits -= 0x3030303030303030;
+          if ((digits & ~(uint64_t) 0x0101010101010101) != 0)
+            goto error;
+          bytes[i / CHAR_BIT] = (digits * 0x0102040810204080) >> 56;
+        }
+      for (; i < size; i++)
+        if (buf[i] == '1')
+          bitmap_mark (b, i);
+        else if (buf[i] != '0')
+          goto error;
+      break;
+    case BITMAP_HEX:
+      for (i = 0; i < byte_cnt; i++)
+        {
+          int hi = hex_value (buf[i * 2]);
+          int lo = hex_value (buf[i * 2 + 1]);
+          if (hi < 0 || lo < 0)
+            goto error;
+          bytes[i] = hi << 4 | lo;
+        }
+      break;
+    default:
+      memcpy (bytes, buf, byte_cnt);
+      break;
+    }
+
+  /* Keep the unused bits past the end 0. */
+  if (bit_cnt > 0)
+    b->bits[elem_cnt (bit_cnt) - 1] &= last_mask (b);
+  return b;
+
+ error:
+  bitmap_destroy (b);
+  return NULL;
+}
+
+/* Debugging. */
+
+/* Dumps the contents of B to the console as hexadecimal. */
+void
+bitmap_dump (const struct bitmap *b) 
+{
+  hex_dump (0, b->bits, byte_cnt (b->bit_cnt)/2, false);
+}
+
+
+struct bitmap *bitmap_expand(struct bitmap *bitmap, int size) {
+    // 현재 비트맵의 크기를 확인합니다.
+    size_t old_size = bitmap_size(bitmap);
+    
+    // 요청된 크기가 현재 크기보다 작거나 같으면 확장할 필요가 없습니다.
+    if (size <= old_size) {
+        return bitmap;
+    }
+
+    // 버퍼나 파일 매핑에 들어 있는 비트맵은 재할당할 수 없으므로 크기를 바꾸지 않습니다.
+    if (!bitmap->owns_bits && bitmap->cow == NULL && bitmap->sparse == NULL) {
+        return NULL;
+    }
+
+    size_t old_elems = elem_cnt(old_size);
+    size_t new_elems = elem_cnt(size);
+
+    // 용량이 모자랄 때만 원소 배열을 재할당합니다.
+    // 용량을 최소 두 배씩 늘리므로 확장 비용은 비트당 상수 시간입니다.
+    if (new_elems > bitmap->elem_cap && bitmap->cow != NULL) {
+        // 스냅샷용 메모리 파일에 들어 있는 비트맵은 파일과 매핑을 함께 늘립니다.
+        if (!cow_grow(bitmap, new_elems)) {
+            return NULL;
+        }
+    }
+    else if (new_elems > bitmap->elem_cap && bitmap->sparse != NULL) {
+        // 희소 비트맵은 매핑과 페이지 표를 함께 늘립니다.
+        if (!sparse_grow(bitmap, new_elems)) {
+            return NULL;
+        }
+    }
+    else if (new_elems > bitmap->elem_cap) {
+        size_t new_cap = bitmap->elem_cap * 2;
+        if (new_cap < new_elems) {
+            new_cap = new_elems;
+        }
+
+        elem_type *new_bits = realloc(bitmap->bits, new_cap * sizeof(elem_type));
+        if (new_bits == NULL) {
+            // 재할당에 실패하면 기존 비트맵은 그대로 남아 있습니다.
+            return NULL;
+        }
+        bitmap->bits = new_bits;
+        bitmap->elem_cap = new_cap;
+    }
+
+    // 새로 쓰이는 원소만 0으로 채웁니다.
+    // 기존 마지막 원소의 남는 비트는 항상 0이므로 따로 지울 필요가 없습니다.
+    // 희소 비트맵은 줄일 때 잘린 비트를 지워 두므로 새 원소가 이미 0입니다.
+    if (bitmap->sparse == NULL) {
+        // 스냅샷이 아직 공유하는 페이지라면 먼저 복사해 둡니다.
+        prepare_write(bitmap, old_elems, new_elems - 1);
+        memset(bitmap->bits + old_elems, 0, (new_elems - old_elems) * sizeof(elem_type));
+    }
+    bitmap->bit_cnt = size;
+
+    // 요약 정보나 순위 색인이 있다면 새 크기에 맞춥니다.
+    if (bitmap->summary != NULL) {
+        summary_resize(bitmap, old_size);
+    }
+    if (bitmap->rank != NULL) {
+        rank_resize(bitmap, old_size);
+    }
+    if (bitmap->runs != NULL) {
+        runs_update(bitmap, old_size, old_size, size);
+    }
+
+    return bitmap;
+}
+
+struct bitmap *bitmap_shrink(struct bitmap *bitmap, size_t size) {
+    // 현재 비트맵의 크기를 확인합니다.
+    size_t old_size = bitmap_size(bitmap);
+
+    // 요청된 크기가 현재 크기보다 크거나 같으면 줄일 필요가 없습니다.
+    if (size >= old_size) {
+        return bitmap;
+    }
+
+    // 버퍼나 파일 매핑에 들어 있는 비트맵은 파일 머리말과 매핑 크기가 어긋나지 않도록 줄이지 않습니다.
+    if (!bitmap->owns_bits && bitmap->cow == NULL && bitmap->sparse == NULL) {
+        return NULL;
+    }
+
+    size_t new_elems = elem_cnt(size);
+
+    // 희소 비트맵은 잘려 나갈 비트를 모두 지웁니다.
+    // 통째로 잘리는 페이지는 커널에 돌려주고, 다시 늘릴 때 새 원소를 채울 필요가 없습니다.
+    if (bitmap->sparse != NULL) {
+        sparse_clear(bitmap, size, old_size - size);
+    }
+
+    // 잘려 나간 비트를 지워 마지막 원소의 남는 비트가 0이 되도록 합니다.
+    bitmap->bit_cnt = size;
+    if (new_elems > 0 && bitmap->sparse == NULL) {
+        prepare_write(bitmap, new_elems - 1, new_elems - 1);
+        bitmap->bits[new_elems - 1] &= last_mask(bitmap);
+    }
+
+    // 요약 정보나 순위 색인이 있다면 새 크기에 맞춥니다.
+    if (bitmap->summary != NULL) {
+        summary_resize(bitmap, old_size);
+    }
+    if (bitmap->rank != NULL) {
+        rank_resize(bitmap, old_size);
+    }
+    if (bitmap->runs != NULL) {
+        runs_update(bitmap, size, old_size, size);
+    }
+
+    // 용량의 1/4 이하만 쓰게 되면 새 크기의 두 배 이상이 남는 데까지 절반씩 줄입니다.
+    // 확장과 축소를 번갈아 해도 매번 재할당하지 않도록 여유를 둡니다.
+    // 메모리 파일에 들어 있는 비트맵은 스냅샷이 파일을 매핑하고 있으므로 줄이지 않습니다.
+    // 희소 비트맵은 지운 페이지를 이미 돌려주었으므로 매핑을 그대로 둡니다.
+    if (new_elems <= bitmap->elem_cap / 4 && bitmap->elem_cap / 2 > 0 && bitmap->cow == NULL
+        && bitmap->sparse == NULL) {
+        size_t new_cap = bitmap->elem_cap / 2;
+        while (new_cap / 2 >= new_elems * 2 && new_cap / 2 > 0) {
+            new_cap /= 2;
+        }
+        elem_type *new_bits = realloc(bitmap->bits, new_cap * sizeof(elem_type));
+        if (new_bits != NULL) {
+            // 실패해도 기존 배열을 그대로 쓰면 되므로 무시합니다.
+            bitmap->bits = new_bits;
+            bitmap->elem_cap = new_cap;
+        }
+    }
 
-    // 확장된 새 비트맵을 반환합니다.
-    return new_bitmap;
+    return bitmap;
 }
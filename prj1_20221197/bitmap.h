@@ -4,15 +4,20 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <stdio.h>
 
 /* Bitmap abstract data type. */
 
 /* Creation and destruction. */
 struct bitmap *bitmap_create (size_t bit_cnt);
+struct bitmap *bitmap_create_sparse (size_t bit_cnt);
 struct bitmap *bitmap_create_in_buf (size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size (size_t bit_cnt);
 void bitmap_destroy (struct bitmap *);
 
+/* Snapshots. */
+struct bitmap *bitmap_snapshot (struct bitmap *);
+
 /* Bitmap size. */
 size_t bitmap_size (const struct bitmap *);
 
@@ -31,14 +36,110 @@ bool bitmap_contains (const struct bitmap *, size_t start, size_t cnt, bool);
 bool bitmap_any (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_none (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
+void bitmap_set_batch (struct bitmap *, const size_t *idx, size_t cnt, bool);
+size_t bitmap_test_batch (const struct bitmap *, const size_t *idx, size_t cnt,
+                          bool *results);
+
+/* Bit-at-a-time reference versions, for testing. */
+size_t bitmap_count_ref (const struct bitmap *, size_t start, size_t cnt, bool);
+bool bitmap_contains_ref (const struct bitmap *, size_t start, size_t cnt, bool);
 
 /* Finding set or unset bits. */
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_range (const struct bitmap *, size_t start, size_t end,
+                          size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
 
+/* Ways of choosing among groups of bits in
+   bitmap_scan_policy(). */
+enum bitmap_policy
+  {
+    BITMAP_FIRST_FIT,           /* First group at or after START. */
+    BITMAP_NEXT_FIT,            /* First group after the last one. */
+    BITMAP_BEST_FIT             /* Group in the smallest run. */
+  };
+size_t bitmap_scan_policy (struct bitmap *, size_t start, size_t cnt, bool,
+                           enum bitmap_policy);
+size_t bitmap_next_set (const struct bitmap *, size_t start);
+size_t bitmap_next_clear (const struct bitmap *, size_t start);
+
+/* Iterates IDX, a size_t, over the index of every bit in BITMAP
+   that is set to true, in increasing order.  Each step jumps
+   straight to the next true bit, so a sparse bitmap is iterated
+   in time proportional to its number of true bits rather than
+   its size.  BITMAP may be modified in the loop body, but bits
+   after IDX that are changed may or may not be visited. */
+#define bitmap_for_each_set_bit(IDX, BITMAP)                            \
+        for ((IDX) = bitmap_next_set ((BITMAP), 0);                     \
+             (IDX) != BITMAP_ERROR;                                     \
+             (IDX) = bitmap_next_set ((BITMAP), (IDX) + 1))
+
+/* Statistics. */
+#define BITMAP_STATS_BUCKETS 16
+struct bitmap_stats
+  {
+    size_t set_cnt;             /* Bits set to true. */
+    size_t clear_cnt;           /* Bits set to false. */
+    size_t free_run_cnt;        /* Maximal runs of false bits. */
+    size_t largest_free_run;    /* Length of the longest of those. */
+    size_t free_run_hist[BITMAP_STATS_BUCKETS];
+                                /* Runs of 2**K through 2**(K+1) - 1
+                                   false bits in bucket K; the last
+                                   bucket also counts longer runs. */
+  };
+void bitmap_stats (const struct bitmap *, struct bitmap_stats *,
+                   size_t region_bits, size_t *region_set);
+
+/* Combining bitmaps of equal size. */
+void bitmap_and (struct bitmap *dst, const struct bitmap *, const struct bitmap *);
+void bitmap_or (struct bitmap *dst, const struct bitmap *, const struct bitmap *);
+void bitmap_xor (struct bitmap *dst, const struct bitmap *, const struct bitmap *);
+void bitmap_andnot (struct bitmap *dst, const struct bitmap *, const struct bitmap *);
+size_t bitmap_and_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_or_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_xor_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_andnot_count (const struct bitmap *, const struct bitmap *);
+
+/* Multiprocessor-safe operations. */
+bool bitmap_atomic_mark (struct bitmap *, size_t idx);
+bool bitmap_atomic_reset (struct bitmap *, size_t idx);
+bool bitmap_atomic_flip (struct bitmap *, size_t idx);
+bool bitmap_atomic_test (const struct bitmap *, size_t idx);
+size_t bitmap_atomic_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+
+/* Summary levels. */
+bool bitmap_enable_summary (struct bitmap *);
+void bitmap_disable_summary (struct bitmap *);
+
+/* Rank and select. */
+bool bitmap_enable_rank (struct bitmap *);
+void bitmap_disable_rank (struct bitmap *);
+size_t bitmap_rank (const struct bitmap *, size_t idx);
+size_t bitmap_select (const struct bitmap *, size_t k);
+
+/* Run index. */
+bool bitmap_enable_runs (struct bitmap *);
+void bitmap_disable_runs (struct bitmap *);
+
 /* File input and output. */
 size_t bitmap_file_size (const struct bitmap *);
+struct bitmap *bitmap_open_mmap (const char *path, size_t bit_cnt);
+bool bitmap_sync (struct bitmap *);
+void bitmap_close_mmap (struct bitmap *);
+
+/* Serialization. */
+enum bitmap_format
+  {
+    BITMAP_BINARY,              /* One '0' or '1' per bit. */
+    BITMAP_HEX,                 /* Two hex digits per byte. */
+    BITMAP_RAW                  /* Bytes, little-endian. */
+  };
+size_t bitmap_encoded_size (const struct bitmap *, enum bitmap_format);
+size_t bitmap_encode (const struct bitmap *, enum bitmap_format, void *);
+bool bitmap_write (const struct bitmap *, enum bitmap_format, FILE *);
+struct bitmap *bitmap_decode (const void *, size_t size, size_t bit_cnt,
+                              enum bitmap_format);
 
 /* Debugging. */
 void bitmap_dump (const struct bitmap *);
@@ -46,10 +147,19 @@ typedef unsigned long elem_type;
 
 
 struct bitmap *bitmap_expand(struct bitmap *bitmap, int size);
+struct bitmap *bitmap_shrink(struct bitmap *bitmap, size_t size);
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t elem_cap;    /* Number of elements allocated in BITS. */
     elem_type *bits;    /* Elements that represent bits. */
+    struct bitmap_summary *summary;     /* Uniform elements, or null. */
+    struct bitmap_rank *rank;   /* Rank and select index, or null. */
+    struct bitmap_runs *runs;   /* Run index, or null. */
+    size_t rotor;       /* Where BITMAP_NEXT_FIT scans resume. */
+    struct bitmap_cow *cow;     /* Snapshot state, or null. */
+    struct bitmap_sparse *sparse;       /* Sparse page state, or null. */
+    bool owns_bits;     /* BITS was allocated with malloc(). */
   };
 
 #endif /* bitmap.h */
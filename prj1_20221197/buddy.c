@@ -0,0 +1,210 @@
+/* Buddy allocator.
+
+   See buddy.h for basic information. */
+
+#include "buddy.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Largest number of orders, enough for any size_t page count. */
+#define ORDER_MAX 64
+
+/* Buddy allocator. */
+struct buddy
+  {
+    size_t page_cnt;            /* Number of pages. */
+    size_t free_pages;          /* Number of pages not allocated. */
+    int order_cnt;              /* Orders are 0...ORDER_CNT - 1. */
+    struct bitmap *free[ORDER_MAX];     /* Free runs of each order. */
+    size_t free_cnt[ORDER_MAX];         /* Bits set in FREE[]. */
+    size_t hint[ORDER_MAX];             /* No bit in FREE[] is set
+                                           before this one. */
+  };
+
+/* Returns the number of pages in a run of the given ORDER. */
+static inline size_t
+order_pages (int order)
+{
+  return (size_t) 1 << order;
+}
+
+/* Adds the run of ORDER at PAGE to the free runs of B. */
+static void
+add_run (struct buddy *b, size_t page, int order)
+{
+  size_t idx = page >> order;
+
+  ASSERT (!bitmap_test (b->free[order], idx));
+  bitmap_mark (b->free[order], idx);
+  b->free_cnt[order]++;
+  if (idx < b->hint[order])
+    b->hint[order] = idx;
+}
+
+/* Removes the run of ORDER at PAGE from the free runs of B. */
+static void
+remove_run (struct buddy *b, size_t page, int order)
+{
+  bitmap_reset (b->free[order], page >> order);
+  b->free_cnt[order]--;
+}
+
+/* Creation and destruction. */
+
+/* Creates and returns a buddy allocator for PAGE_CNT pages,
+   numbered 0 through PAGE_CNT - 1, all of them free.  PAGE_CNT
+   need not be a power of two.  Returns a null pointer if
+   PAGE_CNT is 0 or memory allocation failed. */
+struct buddy *
+buddy_create (size_t page_cnt)
+{
+  struct buddy *b;
+  size_t page;
+  int order;
+
+  if (page_cnt == 0)
+    return NULL;
+  b = calloc (1, sizeof *b);
+  if (b == NULL)
+    return NULL;
+
+  b->page_cnt = page_cnt;
+  while (b->order_cnt < ORDER_MAX && order_pages (b->order_cnt) <= page_cnt)
+    b->order_cnt++;
+  for (order = 0; order < b->order_cnt; order++)
+    {
+      b->free[order] = bitmap_create (page_cnt >> order);
+      if (b->free[order] == NULL)
+        {
+          buddy_destroy (b);
+          return NULL;
+        }
+
+      /* Free runs are few and far between at most orders, which
+         is what the summary is for. */
+      bitmap_enable_summary (b->free[order]);
+    }
+
+  /* Cover the pages with the largest aligned runs that fit. */
+  for (page = 0; page < page_cnt; )
+    {
+      order = b->order_cnt - 1;
+      while (page % order_pages (order) != 0
+             || order_pages (order) > page_cnt - page)
+        order--;
+      add_run (b, page, order);
+      page += order_pages (order);
+    }
+  b->free_pages = page_cnt;
+  return b;
+}
+
+/* Destroys buddy allocator B, freeing its storage.  Pages still
+   allocated from it are forgotten. */
+void
+buddy_destroy (struct buddy *b)
+{
+  if (b != NULL)
+    {
+      int order;
+
+      for (order = 0; order < b->order_cnt; order++)
+        bitmap_destroy (b->free[order]);
+      free (b);
+    }
+}
+
+/* Size. */
+
+/* Returns the number of pages managed by B. */
+size_t
+buddy_size (const struct buddy *b)
+{
+  return b->page_cnt;
+}
+
+/* Returns the number of pages in B that are not allocated. */
+size_t
+buddy_free_pages (const struct buddy *b)
+{
+  return b->free_pages;
+}
+
+/* Returns the largest order that B can allocate. */
+int
+buddy_max_order (const struct buddy *b)
+{
+  return b->order_cnt - 1;
+}
+
+/* Allocation. */
+
+/* Allocates a run of 2**ORDER pages from B and returns the
+   number of its first page, which is a multiple of 2**ORDER.
+   Returns BITMAP_ERROR if no free run is that large, or if
+   ORDER is out of range. */
+size_t
+buddy_alloc (struct buddy *b, int order)
+{
+  size_t idx, page;
+  int k;
+
+  ASSERT (b != NULL);
+
+  if (order < 0 || order >= b->order_cnt)
+    return BITMAP_ERROR;
+
+  /* Find the smallest order with a free run. */
+  for (k = order; k < b->order_cnt && b->free_cnt[k] == 0; k++)
+    continue;
+  if (k >= b->order_cnt)
+    return BITMAP_ERROR;
+
+  /* Take its lowest free run... */
+  idx = bitmap_next_set (b->free[k], b->hint[k]);
+  ASSERT (idx != BITMAP_ERROR);
+  b->hint[k] = idx;
+  page = idx << k;
+  remove_run (b, page, k);
+
+  /* ...and split it down to size, freeing the upper halves. */
+  while (k > order)
+    {
+      k--;
+      add_run (b, page + order_pages (k), k);
+    }
+
+  b->free_pages -= order_pages (order);
+  return page;
+}
+
+/* Frees the run of 2**ORDER pages starting at PAGE in B, which
+   must have been returned by buddy_alloc (B, ORDER), merging it
+   with its buddy for as long as the buddy is free. */
+void
+buddy_free (struct buddy *b, size_t page, int order)
+{
+  ASSERT (b != NULL);
+  ASSERT (order >= 0 && order < b->order_cnt);
+  ASSERT (page % order_pages (order) == 0);
+  ASSERT (page + order_pages (order) <= b->page_cnt);
+
+  b->free_pages += order_pages (order);
+  while (order + 1 < b->order_cnt)
+    {
+      size_t buddy = page ^ order_pages (order);
+      size_t idx = buddy >> order;
+
+      /* A buddy past the end of the last whole run of this
+         order was never free. */
+      if (idx >= bitmap_size (b->free[order])
+          || !bitmap_test (b->free[order], idx))
+        break;
+      remove_run (b, buddy, order);
+      page &= ~order_pages (order);
+      order++;
+    }
+  add_run (b, page, order);
+}
@@ -0,0 +1,45 @@
+#ifndef __MYLIB_BUDDY_H
+#define __MYLIB_BUDDY_H
+
+/* Buddy allocator.
+
+   A buddy allocator hands out runs of pages whose length is a
+   power of two, 2**ORDER pages for some ORDER, always aligned to
+   their own length.  Every free run is kept whole in a struct
+   bitmap for its order, in which bit I stands for pages
+   I * 2**ORDER through (I + 1) * 2**ORDER - 1.
+
+   An allocation takes the lowest free run of the smallest order
+   that is large enough and splits it in halves until it is the
+   right size, putting the unused halves back at the lower
+   orders.  Freeing a run merges it with its "buddy", the other
+   half of the run it was split from, as long as that is free
+   too.  Both take O(log n) steps, one per order, plus finding a
+   free run, which the per-order free counts and the bitmaps'
+   summary levels keep short; compare bitmap_scan_and_flip(),
+   which walks the whole bitmap and leaves small holes
+   scattered everywhere.
+
+   Runs must be freed with the same order they were allocated
+   with. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "bitmap.h"
+
+struct buddy;
+
+/* Creation and destruction. */
+struct buddy *buddy_create (size_t page_cnt);
+void buddy_destroy (struct buddy *);
+
+/* Size. */
+size_t buddy_size (const struct buddy *);
+size_t buddy_free_pages (const struct buddy *);
+int buddy_max_order (const struct buddy *);
+
+/* Allocation. */
+size_t buddy_alloc (struct buddy *, int order);
+void buddy_free (struct buddy *, size_t page, int order);
+
+#endif /* buddy.h */
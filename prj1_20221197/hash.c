@@ -4,33 +4,108 @@ See hash.h for basic information. */
 
 #include "hash.h"
 #include <assert.h>	
+#include <stdio.h>
 #include <stdlib.h>	
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define ASSERT(CONDITION) assert(CONDITION)	
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
 
-static struct list *find_bucket (struct hash *, struct hash_elem *);
+static struct list *find_bucket (struct hash *, unsigned);
 static struct hash_elem *find_elem (struct hash *, struct list *,
-                                    struct hash_elem *);
-static void insert_elem (struct hash *, struct list *, struct hash_elem *);
+                                    struct hash_elem *, unsigned);
+static void insert_elem (struct hash *, struct list *, struct hash_elem *,
+                         unsigned);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static bool start_rehash (struct hash *, size_t);
+static void migrate (struct hash *, size_t);
+static struct list *next_bucket (struct hash *, size_t *);
+static size_t open_find (struct hash *, struct hash_elem *, unsigned);
+static struct hash_elem *open_insert (struct hash *, struct hash_elem *,
+                                      bool replace);
+static void open_remove (struct hash *, size_t);
+static void open_rehash (struct hash *, size_t);
+static bool open_resize (struct hash *, size_t);
+static size_t swiss_find (struct hash *, struct hash_elem *, unsigned);
+static struct hash_elem *swiss_insert (struct hash *, struct hash_elem *,
+                                       bool replace);
+static void swiss_remove (struct hash *, size_t);
+static bool swiss_rehash (struct hash *, size_t);
+static void swiss_clear_ctrl (struct hash *);
+static size_t min_size (const struct hash *);
+static size_t ideal_size (const struct hash *, size_t);
+static bool resize (struct hash *, size_t);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
 bool
 hash_init (struct hash *h,
            hash_hash_func *hash, hash_less_func *less, void *aux) 
+{
+  return hash_init_engine (h, HASH_CHAINED, hash, less, aux);
+}
+
+/* Minimum number of slots in an open-addressing table. */
+#define MIN_SLOTS 8
+
+/* Most elements that room can be made for in advance.  The
+   buckets or slots for more would take more bytes than a size_t
+   can count. */
+#define MAX_CAPACITY (SIZE_MAX / 64)
+
+/* Initializes hash table H like hash_init(), but to store its
+   elements as ENGINE says. */
+bool
+hash_init_engine (struct hash *h, enum hash_engine engine,
+                  hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  return hash_init_with_capacity (h, engine, 0, hash, less, aux);
+}
+
+/* Initializes hash table H like hash_init_engine(), but with
+   room for CAPACITY elements from the start, as if by
+   hash_reserve(), so that inserting that many elements does not
+   have to resize it. */
+bool
+hash_init_with_capacity (struct hash *h, enum hash_engine engine,
+                         size_t capacity, hash_hash_func *hash,
+                         hash_less_func *less, void *aux)
 {
   h->elem_cnt = 0;
-  h->bucket_cnt = 4;
-  h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->bucket_cnt = 0;
+  h->buckets = NULL;
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
+  h->slots = NULL;
+  h->ctrl = NULL;
+  h->deleted_cnt = 0;
+  h->engine = engine;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
+  h->min_bucket_cnt = min_size (h);
+  if (capacity > MAX_CAPACITY)
+    return false;
+  h->min_bucket_cnt = ideal_size (h, capacity);
+
+  if (engine == HASH_OPEN)
+    {
+      h->bucket_cnt = h->min_bucket_cnt;
+      h->slots = calloc (h->bucket_cnt, sizeof *h->slots);
+      return h->slots != NULL;
+    }
+  if (engine == HASH_SWISS)
+    return swiss_rehash (h, h->min_bucket_cnt);
 
+  h->bucket_cnt = h->min_bucket_cnt;
+  h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
   if (h->buckets != NULL) 
     {
       hash_clear (h, NULL);
@@ -54,6 +129,27 @@ hash_clear (struct hash *h, hash_action_func *destructor)
 {
   size_t i;
 
+  if (h->engine != HASH_CHAINED)
+    {
+      for (i = 0; i < h->bucket_cnt; i++)
+        if (h->slots[i].elem != NULL)
+          {
+            struct hash_elem *hash_elem = h->slots[i].elem;
+            h->slots[i].elem = NULL;
+            if (destructor != NULL)
+              destructor (hash_elem, h->aux);
+          }
+      if (h->engine == HASH_SWISS)
+        swiss_clear_ctrl (h);
+      h->elem_cnt = 0;
+      return;
+    }
+
+  /* Finish any rehash in progress, so that every element is in
+     the current buckets. */
+  if (h->old_buckets != NULL)
+    migrate (h, h->old_bucket_cnt);
+
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -88,6 +184,9 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear (h, destructor);
   free (h->buckets);
+  free (h->old_buckets);
+  free (h->slots);
+  free (h->ctrl);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -97,11 +196,17 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new)
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  if (h->engine == HASH_OPEN)
+    return open_insert (h, new, false);
+  if (h->engine == HASH_SWISS)
+    return swiss_insert (h, new, false);
+
+  unsigned hash = h->hash (new, h->aux);
+  struct list *bucket = find_bucket (h, hash);
+  struct hash_elem *old = find_elem (h, bucket, new, hash);
 
   if (old == NULL) 
-    insert_elem (h, bucket, new);
+    insert_elem (h, bucket, new, hash);
 
   rehash (h);
 
@@ -113,12 +218,18 @@ hash_insert (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) 
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  if (h->engine == HASH_OPEN)
+    return open_insert (h, new, true);
+  if (h->engine == HASH_SWISS)
+    return swiss_insert (h, new, true);
+
+  unsigned hash = h->hash (new, h->aux);
+  struct list *bucket = find_bucket (h, hash);
+  struct hash_elem *old = find_elem (h, bucket, new, hash);
 
   if (old != NULL)
     remove_elem (h, old);
-  insert_elem (h, bucket, new);
+  insert_elem (h, bucket, new, hash);
 
   rehash (h);
 
@@ -130,7 +241,15 @@ hash_replace (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) 
 {
-  return find_elem (h, find_bucket (h, e), e);
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->engine != HASH_CHAINED)
+    {
+      size_t i = (h->engine == HASH_OPEN
+                  ? open_find (h, e, hash) : swiss_find (h, e, hash));
+      return i < h->bucket_cnt ? h->slots[i].elem : NULL;
+    }
+  return find_elem (h, find_bucket (h, hash), e, hash);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -143,7 +262,32 @@ hash_find (struct hash *h, struct hash_elem *e)
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e)
 {
-  struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+  if (h->engine == HASH_OPEN)
+    {
+      size_t i = open_find (h, e, h->hash (e, h->aux));
+      struct hash_elem *found;
+
+      if (i == h->bucket_cnt)
+        return NULL;
+      found = h->slots[i].elem;
+      open_remove (h, i);
+      open_rehash (h, h->elem_cnt);
+      return found;
+    }
+  if (h->engine == HASH_SWISS)
+    {
+      size_t i = swiss_find (h, e, h->hash (e, h->aux));
+      struct hash_elem *found;
+
+      if (i == h->bucket_cnt)
+        return NULL;
+      found = h->slots[i].elem;
+      swiss_remove (h, i);
+      return found;
+    }
+
+  unsigned hash = h->hash (e, h->aux);
+  struct hash_elem *found = find_elem (h, find_bucket (h, hash), e, hash);
   if (found != NULL) 
     {
       remove_elem (h, found);
@@ -161,13 +305,22 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
+  struct list *bucket;
   size_t i;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  if (h->engine != HASH_CHAINED)
+    {
+      for (i = 0; i < h->bucket_cnt; i++)
+        if (h->slots[i].elem != NULL)
+          action (h->slots[i].elem, h->aux);
+      return;
+    }
+
+  i = (size_t) -1;
+  while ((bucket = next_bucket (h, &i)) != NULL)
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -202,7 +355,16 @@ hash_first (struct hash_iterator *i, struct hash *h)
   ASSERT (h != NULL);
 
   i->hash = h;
-  i->bucket = i->hash->buckets;
+  if (h->engine != HASH_CHAINED)
+    {
+      /* hash_next() steps to slot 0 first. */
+      i->bucket = NULL;
+      i->slot = (size_t) -1;
+      i->elem = NULL;
+      return;
+    }
+  i->slot = (size_t) -1;
+  i->bucket = next_bucket (h, &i->slot);
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -219,10 +381,22 @@ hash_next (struct hash_iterator *i)
 {
   ASSERT (i != NULL);
 
+  if (i->hash->engine != HASH_CHAINED)
+    {
+      struct hash *h = i->hash;
+
+      i->elem = NULL;
+      while (i->slot + 1 < h->bucket_cnt)
+        if (h->slots[++i->slot].elem != NULL)
+          return i->elem = h->slots[i->slot].elem;
+      return NULL;
+    }
+
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, &i->slot);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -256,6 +430,45 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
+/* Makes room in hash table H for CNT elements, so that it will
+   not need to grow until it holds more than that.  H also keeps
+   that much room when elements are deleted, instead of shrinking
+   as it otherwise would, until hash_shrink_to_fit() is called.
+   Any resizing needed is done at once.  Returns true if
+   successful, false if out of memory, in which case H is
+   unchanged. */
+bool
+hash_reserve (struct hash *h, size_t cnt) 
+{
+  size_t new_cnt;
+
+  if (cnt > MAX_CAPACITY)
+    return false;
+  new_cnt = ideal_size (h, cnt);
+  if (new_cnt > h->bucket_cnt && !resize (h, new_cnt))
+    return false;
+  h->min_bucket_cnt = new_cnt;
+  return true;
+}
+
+/* Shrinks hash table H to the size that best suits the elements
+   it holds now, and lets it shrink again as elements are
+   deleted, undoing any hash_reserve().  Running out of memory
+   just leaves H larger than it needs to be. */
+void
+hash_shrink_to_fit (struct hash *h) 
+{
+  size_t new_cnt;
+
+  h->min_bucket_cnt = min_size (h);
+  new_cnt = ideal_size (h, h->elem_cnt);
+
+  /* Rebuilding a HASH_SWISS table also clears out its deleted
+     slots, which is worth doing even if its size stays. */
+  if (new_cnt < h->bucket_cnt || h->deleted_cnt > 0)
+    resize (h, new_cnt);
+}
+
 /* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
 #define FNV_32_PRIME 16777619u
 #define FNV_32_BASIS 2166136261u
@@ -300,25 +513,65 @@ hash_int (int i)
   return hash_bytes (&i, sizeof i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that an element with hash value HASH
+   belongs in.  While H is being rehashed, that is the old bucket
+   HASH selects if that has not been moved yet, since old buckets
+   are moved whole. */
 static struct list *
-find_bucket (struct hash *h, struct hash_elem *e) 
+find_bucket (struct hash *h, unsigned hash) 
+{
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns true if bucket IDX of H has been set up.  While H is
+   being rehashed, a new bucket is set up only when the first old
+   bucket whose elements can go there is moved. */
+static inline bool
+bucket_ready (const struct hash *h, size_t idx)
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  return (h->old_buckets == NULL
+          || (idx & (h->old_bucket_cnt - 1)) < h->migrate_idx);
 }
 
-/* Searches BUCKET in H for a hash element equal to E.  Returns
-   it if found or a null pointer otherwise. */
+/* Advances *IDX to the next bucket of H in iteration order and
+   returns it, or a null pointer if there are no more.  Starting
+   from (size_t) -1 yields the first bucket.  The iteration order
+   is the current buckets that are set up, followed by the old
+   buckets not yet moved if H is being rehashed. */
+static struct list *
+next_bucket (struct hash *h, size_t *idx)
+{
+  size_t old_idx;
+
+  while (++*idx < h->bucket_cnt)
+    if (bucket_ready (h, *idx))
+      return &h->buckets[*idx];
+  old_idx = *idx - h->bucket_cnt + h->migrate_idx;
+  return old_idx < h->old_bucket_cnt ? &h->old_buckets[old_idx] : NULL;
+}
+
+/* Searches BUCKET in H for a hash element equal to E, whose hash
+   value is HASH.  Returns it if found or a null pointer
+   otherwise.  Elements with a different hash value cannot be
+   equal to E, so the LESS function is called only for elements
+   whose cached hash value is also HASH. */
 static struct hash_elem *
-find_elem (struct hash *h, struct list *bucket, struct hash_elem *e) 
+find_elem (struct hash *h, struct list *bucket, struct hash_elem *e,
+           unsigned hash) 
 {
   struct list_elem *i;
 
   for (i = list_begin (bucket); i != list_end (bucket); i = list_next (i)) 
     {
       struct hash_elem *hi = list_elem_to_hash_elem (i);
-      if (!h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
+      if (hi->hash == hash
+          && !h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
         return hi; 
     }
   return NULL;
@@ -338,83 +591,139 @@ is_power_of_2 (size_t x)
   return x != 0 && turn_off_least_1bit (x) == 0;
 }
 
-/* Element per bucket ratios. */
+/* Element per bucket ratios.  A table is resized only once it
+   is outside the range from MIN_ELEMS_PER_BUCKET to
+   MAX_ELEMS_PER_BUCKET, to the size that brings it back to
+   around BEST_ELEMS_PER_BUCKET, so that it takes doubling or
+   halving the number of elements to resize it again. */
 #define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets moved by each call to rehash() during a rehash.
+   A rehash of B buckets is thus done after B / MIGRATE_BUCKETS
+   insertions or deletions, well before the element count can
+   have doubled or halved again.  A new bucket count that is
+   called for in the meantime waits until then. */
+#define MIGRATE_BUCKETS 4
+
 /* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   ideal, if it has strayed outside the range of elements per
+   bucket allowed.  This function can fail because of an
+   out-of-memory condition, but that'll just make hash accesses
+   less efficient; we can still continue.
+
+   Rather than moving every element at once, which would make a
+   single insertion or deletion into a big table take as long as
+   all the others since the last rehash together, this sets up
+   the new buckets and keeps the old ones in H->old_buckets.
+   This call and each later one then move the elements of
+   MIGRATE_BUCKETS old buckets, until none are left. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
-  size_t i;
-
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
-
-  /* Calculate the number of buckets to use now.
-     We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-     We must have at least four buckets, and the number of
-     buckets must be a power of 2. */
-  new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-  if (new_bucket_cnt < 4)
-    new_bucket_cnt = 4;
-  while (!is_power_of_2 (new_bucket_cnt))
-    new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
-
-  /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  /* Carry on with a rehash in progress before starting another. */
+  if (h->old_buckets != NULL)
+    {
+      migrate (h, MIGRATE_BUCKETS);
+      return;
+    }
+
+  /* Don't do anything while the load is within range, or if the
+     table may not shrink any further. */
+  if (h->elem_cnt <= h->bucket_cnt * MAX_ELEMS_PER_BUCKET
+      && (h->elem_cnt >= h->bucket_cnt * MIN_ELEMS_PER_BUCKET
+          || h->bucket_cnt <= h->min_bucket_cnt))
     return;
 
-  /* Allocate new buckets and initialize them as empty. */
+  if (start_rehash (h, ideal_size (h, h->elem_cnt)))
+    migrate (h, MIGRATE_BUCKETS);
+}
+
+/* Starts rehashing hash table H, which is not being rehashed
+   already, into NEW_BUCKET_CNT buckets, leaving the elements to
+   be moved by migrate().  Returns true if successful, false if
+   out of memory, in which case H is unchanged. */
+static bool
+start_rehash (struct hash *h, size_t new_bucket_cnt)
+{
+  struct list *new_buckets;
+
+  ASSERT (h->old_buckets == NULL);
+  ASSERT (is_power_of_2 (new_bucket_cnt));
+
+  /* Allocate new buckets.  They are initialized as empty by
+     migrate(), just before they can first be used, so that the
+     cost of touching them is spread out too. */
   new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
   if (new_buckets == NULL) 
     {
       /* Allocation failed.  This means that use of the hash table will
          be less efficient.  However, it is still usable, so
          there's no reason for it to be an error. */
-      return;
+      return false;
     }
-  for (i = 0; i < new_bucket_cnt; i++) 
-    list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until all
+     of their elements have been moved. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  return true;
+}
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+/* Moves each element of the next CNT old buckets of H, which is
+   being rehashed, into the appropriate new bucket, and frees the
+   old buckets once they are all empty. */
+static void
+migrate (struct hash *h, size_t cnt)
+{
+  for (; cnt > 0 && h->migrate_idx < h->old_bucket_cnt; cnt--)
     {
-      struct list *old_bucket;
+      size_t old_idx = h->migrate_idx++;
+      struct list *old_bucket = &h->old_buckets[old_idx];
       struct list_elem *elem, *next;
+      size_t i;
+
+      /* Set up the new buckets that this old bucket is the first
+         to feed: those it splits into when growing, or the one
+         it merges into when shrinking, if it is the first of
+         those merged. */
+      for (i = old_idx; i < h->bucket_cnt; i += h->old_bucket_cnt)
+        list_init (&h->buckets[i]);
 
-      old_bucket = &old_buckets[i];
       for (elem = list_begin (old_bucket);
            elem != list_end (old_bucket); elem = next) 
         {
+          struct hash_elem *e = list_elem_to_hash_elem (elem);
           struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
+            = &h->buckets[e->hash & (h->bucket_cnt - 1)];
           next = list_next (elem);
           list_remove (elem);
           list_push_front (new_bucket, elem);
         }
     }
 
-  free (old_buckets);
+  if (h->migrate_idx == h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->migrate_idx = 0;
+    }
 }
 
-/* Inserts E into BUCKET (in hash table H). */
+/* Inserts E, whose hash value is HASH, into BUCKET (in hash
+   table H). */
 static void
-insert_elem (struct hash *h, struct list *bucket, struct hash_elem *e) 
+insert_elem (struct hash *h, struct list *bucket, struct hash_elem *e,
+             unsigned hash) 
 {
+  e->hash = hash;
   h->elem_cnt++;
   list_push_front (bucket, &e->list_elem);
 }
@@ -427,6 +736,498 @@ remove_elem (struct hash *h, struct hash_elem *e)
   list_remove (&e->list_elem);
 }
 
+/* Open addressing.
+
+   An open-addressing table keeps its elements in H->slots, an
+   array of H->bucket_cnt slots.  An element belongs in the slot
+   its hash value selects, its home slot, or if that is taken, in
+   the first free slot after it, wrapping around at the end.
+
+   Robin Hood probing keeps the elements that follow a home slot
+   in order of their distance from home: inserting an element
+   takes over the slot of the first element that is closer to its
+   own home than the new one would be, and that element moves on
+   in turn.  A search can thus stop as soon as it reaches an
+   element closer to home than the one sought would be, and
+   deleting an element shifts the following elements back one
+   slot instead of leaving a marker behind, so that searches never
+   get slower as elements come and go.
+
+   The table is kept between MIN_SLOT_LOAD and MAX_SLOT_LOAD full,
+   as fractions of 8. */
+#define MIN_SLOT_LOAD 1         /* Below 1/8 full: halve the slots. */
+#define MAX_SLOT_LOAD 6         /* Above 3/4 full: double the slots. */
+
+/* Returns how far slot I of open-addressing table H is from the
+   home slot of its element. */
+static inline size_t
+slot_distance (const struct hash *h, size_t i)
+{
+  return (i - h->slots[i].hash) & (h->bucket_cnt - 1);
+}
+
+/* Returns the index of the slot in open-addressing table H that
+   holds an element equal to E, whose hash value is HASH, or
+   H->bucket_cnt if there is none.  The LESS function is called
+   only for elements whose hash value is also HASH. */
+static size_t
+open_find (struct hash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t i = hash & mask;
+  size_t dist;
+
+  for (dist = 0; dist < h->bucket_cnt; dist++, i = (i + 1) & mask)
+    {
+      struct hash_slot *s = &h->slots[i];
+
+      if (s->elem == NULL || slot_distance (h, i) < dist)
+        break;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        return i;
+    }
+  return h->bucket_cnt;
+}
+
+/* Puts E, whose hash value is HASH, into open-addressing table H,
+   which must have a free slot and must not already hold an
+   element equal to E. */
+static void
+open_place (struct hash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t i = hash & mask;
+  struct hash_slot new = { e, hash };
+  size_t dist;
+
+  for (dist = 0; h->slots[i].elem != NULL; dist++, i = (i + 1) & mask)
+    {
+      size_t old_dist = slot_distance (h, i);
+
+      if (old_dist < dist)
+        {
+          /* Take the slot and carry its element on instead. */
+          struct hash_slot old = h->slots[i];
+          h->slots[i] = new;
+          new = old;
+          dist = old_dist;
+        }
+    }
+  h->slots[i] = new;
+}
+
+/* Inserts NEW into open-addressing table H.  If an equal element
+   is already in the table, returns it, replacing it with NEW if
+   REPLACE is true.  Otherwise, returns a null pointer. */
+static struct hash_elem *
+open_insert (struct hash *h, struct hash_elem *new, bool replace)
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t i = open_find (h, new, hash);
+
+  new->hash = hash;
+
+  if (i < h->bucket_cnt)
+    {
+      struct hash_elem *old = h->slots[i].elem;
+      if (replace)
+        h->slots[i].elem = new;
+      return old;
+    }
+
+  open_rehash (h, h->elem_cnt + 1);
+  if (h->elem_cnt == h->bucket_cnt)
+    {
+      /* Every slot is taken and there was no memory for more.
+         Insertion cannot report failure, so give up. */
+      fprintf (stderr, "hash: out of memory growing table\n");
+      abort ();
+    }
+  open_place (h, new, hash);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Empties slot I of open-addressing table H, shifting back the
+   elements that follow it that are not in their home slots. */
+static void
+open_remove (struct hash *h, size_t i)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t next;
+
+  for (next = (i + 1) & mask;
+       h->slots[next].elem != NULL && slot_distance (h, next) > 0;
+       next = (next + 1) & mask)
+    {
+      h->slots[i] = h->slots[next];
+      i = next;
+    }
+  h->slots[i].elem = NULL;
+  h->elem_cnt--;
+}
+
+/* Changes the number of slots in open-addressing table H, if
+   needed to keep it between MIN_SLOT_LOAD and MAX_SLOT_LOAD full
+   once it holds ELEM_CNT elements, to the power of 2 that leaves
+   it between a quarter and half full.  As with rehash(), running
+   out of memory just leaves the table fuller than ideal. */
+static void
+open_rehash (struct hash *h, size_t elem_cnt)
+{
+  if (elem_cnt <= h->bucket_cnt / 8 * MAX_SLOT_LOAD
+      && (elem_cnt >= h->bucket_cnt / 8 * MIN_SLOT_LOAD
+          || h->bucket_cnt <= h->min_bucket_cnt))
+    return;
+  open_resize (h, ideal_size (h, elem_cnt));
+}
+
+/* Moves the elements of open-addressing table H into a new array
+   of SLOT_CNT slots, which must be enough to hold them all.
+   Returns true if successful, false if out of memory, in which
+   case H is unchanged. */
+static bool
+open_resize (struct hash *h, size_t slot_cnt)
+{
+  struct hash_slot *old_slots = h->slots;
+  size_t old_slot_cnt = h->bucket_cnt;
+  size_t i;
+
+  if (slot_cnt == old_slot_cnt)
+    return true;
+
+  h->slots = calloc (slot_cnt, sizeof *h->slots);
+  if (h->slots == NULL)
+    {
+      h->slots = old_slots;
+      return false;
+    }
+  h->bucket_cnt = slot_cnt;
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      open_place (h, old_slots[i].elem, old_slots[i].hash);
+  free (old_slots);
+  return true;
+}
+
+/* Group probing.
+
+   A HASH_SWISS table is an open-addressing table whose slots are
+   shadowed by H->ctrl, one control byte per slot.  The control
+   byte of a slot holding an element is the low 7 bits of the
+   element's hash value, which is never negative; the control
+   byte of any other slot is CTRL_EMPTY or CTRL_DELETED, both
+   negative.  The first GROUP_SIZE control bytes are repeated
+   after the last one, so that GROUP_SIZE bytes can be loaded
+   starting at any slot without wrapping around.
+
+   The rest of the hash value picks the slot where probing
+   starts.  Probing looks at GROUP_SIZE slots at a time, comparing
+   all of their control bytes at once, moving on by one group
+   more each time, which visits every slot once the table is a
+   power of 2 of at least GROUP_SIZE slots.  A search ends at the
+   first group with an empty slot, since an insertion would have
+   used it.  Deleting an element therefore must usually leave
+   CTRL_DELETED behind, so that searches carry on past it, and
+   deleted slots count toward the load until the table is
+   rehashed. */
+#define GROUP_SIZE 16           /* Slots whose control bytes are
+                                   compared at once. */
+#define CTRL_EMPTY (-128)       /* Never held an element since rehash. */
+#define CTRL_DELETED (-2)       /* Held an element that was deleted. */
+#define MAX_CTRL_LOAD 7         /* Above 7/8 full, counting deleted
+                                   slots: rehash. */
+
+/* Returns a mask with bit I set if control byte I of the group
+   starting at CTRL is C. */
+static inline unsigned
+group_match (const signed char *ctrl, signed char c)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128 ((const __m128i *) ctrl);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (group, _mm_set1_epi8 (c)));
+#else
+  unsigned mask = 0;
+  int i;
+
+  for (i = 0; i < GROUP_SIZE; i++)
+    if (ctrl[i] == c)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+/* Returns a mask with bit I set if the slot of control byte I of
+   the group starting at CTRL is empty or deleted. */
+static inline unsigned
+group_match_free (const signed char *ctrl)
+{
+#ifdef __SSE2__
+  /* Those are the control bytes with the sign bit set. */
+  return _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) ctrl));
+#else
+  unsigned mask = 0;
+  int i;
+
+  for (i = 0; i < GROUP_SIZE; i++)
+    if (ctrl[i] < 0)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+/* Returns the control byte for an element with hash value
+   HASH. */
+static inline signed char
+ctrl_hash (unsigned hash)
+{
+  return hash & 0x7f;
+}
+
+/* Returns the slot where probing starts for hash value HASH in
+   table H. */
+static inline size_t
+probe_start (const struct hash *h, unsigned hash)
+{
+  return (hash >> 7) & (h->bucket_cnt - 1);
+}
+
+/* Sets the control byte for slot I of H to C, and its copy past
+   the end too, if it has one. */
+static inline void
+set_ctrl (struct hash *h, size_t i, signed char c)
+{
+  h->ctrl[i] = c;
+  if (i < GROUP_SIZE)
+    h->ctrl[h->bucket_cnt + i] = c;
+}
+
+/* Marks every slot of H empty. */
+static void
+swiss_clear_ctrl (struct hash *h)
+{
+  memset (h->ctrl, CTRL_EMPTY, h->bucket_cnt + GROUP_SIZE);
+  h->deleted_cnt = 0;
+}
+
+/* Returns the index of the slot in HASH_SWISS table H that holds
+   an element equal to E, whose hash value is HASH, or
+   H->bucket_cnt if there is none.  The LESS function is called
+   only for elements whose control byte and hash value match. */
+static size_t
+swiss_find (struct hash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t pos = probe_start (h, hash);
+  signed char c = ctrl_hash (hash);
+  size_t step;
+
+  for (step = GROUP_SIZE; step <= h->bucket_cnt; step += GROUP_SIZE)
+    {
+      unsigned match = group_match (&h->ctrl[pos], c);
+
+      for (; match != 0; match &= match - 1)
+        {
+          size_t i = (pos + __builtin_ctz (match)) & mask;
+          struct hash_slot *s = &h->slots[i];
+
+          if (s->hash == hash
+              && !h->less (s->elem, e, h->aux)
+              && !h->less (e, s->elem, h->aux))
+            return i;
+        }
+      if (group_match (&h->ctrl[pos], CTRL_EMPTY) != 0)
+        break;
+      pos = (pos + step) & mask;
+    }
+  return h->bucket_cnt;
+}
+
+/* Returns the first empty or deleted slot in the probe sequence
+   for hash value HASH in HASH_SWISS table H, which must have
+   one. */
+static size_t
+swiss_find_free (struct hash *h, unsigned hash)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t pos = probe_start (h, hash);
+  size_t step;
+
+  for (step = GROUP_SIZE; ; step += GROUP_SIZE)
+    {
+      unsigned match = group_match_free (&h->ctrl[pos]);
+
+      if (match != 0)
+        return (pos + __builtin_ctz (match)) & mask;
+      pos = (pos + step) & mask;
+    }
+}
+
+/* Puts E, whose hash value is HASH, into HASH_SWISS table H,
+   which must have a free slot and must not already hold an
+   element equal to E. */
+static void
+swiss_place (struct hash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t i = swiss_find_free (h, hash);
+
+  if (h->ctrl[i] == CTRL_DELETED)
+    h->deleted_cnt--;
+  set_ctrl (h, i, ctrl_hash (hash));
+  h->slots[i].elem = e;
+  h->slots[i].hash = hash;
+}
+
+/* Inserts NEW into HASH_SWISS table H.  If an equal element is
+   already in the table, returns it, replacing it with NEW if
+   REPLACE is true.  Otherwise, returns a null pointer. */
+static struct hash_elem *
+swiss_insert (struct hash *h, struct hash_elem *new, bool replace)
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t i = swiss_find (h, new, hash);
+
+  new->hash = hash;
+
+  if (i < h->bucket_cnt)
+    {
+      struct hash_elem *old = h->slots[i].elem;
+      if (replace)
+        h->slots[i].elem = new;
+      return old;
+    }
+
+  if (h->elem_cnt + h->deleted_cnt + 1 > h->bucket_cnt / 8 * MAX_CTRL_LOAD)
+    {
+      /* Rehashing also clears out the deleted slots, so it may
+         leave the number of slots as it is. */
+      if (!swiss_rehash (h, ideal_size (h, h->elem_cnt + 1))
+          && h->elem_cnt + h->deleted_cnt == h->bucket_cnt)
+        {
+          fprintf (stderr, "hash: out of memory growing table\n");
+          abort ();
+        }
+    }
+  swiss_place (h, new, hash);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Empties slot I of HASH_SWISS table H. */
+static void
+swiss_remove (struct hash *h, size_t i)
+{
+  size_t mask = h->bucket_cnt - 1;
+  unsigned before = group_match (&h->ctrl[(i - GROUP_SIZE) & mask],
+                                 CTRL_EMPTY);
+  unsigned after = group_match (&h->ctrl[i], CTRL_EMPTY);
+
+  /* If the empty slots nearest before and after slot I are less
+     than a group apart, every group that contains slot I also
+     contains an empty slot, so no search has ever had to probe
+     past slot I and it can simply be made empty again. */
+  if (before != 0 && after != 0
+      && __builtin_ctz (after) + __builtin_clz (before << 16) < GROUP_SIZE)
+    set_ctrl (h, i, CTRL_EMPTY);
+  else
+    {
+      set_ctrl (h, i, CTRL_DELETED);
+      h->deleted_cnt++;
+    }
+  h->slots[i].elem = NULL;
+  h->elem_cnt--;
+
+  if (h->elem_cnt < h->bucket_cnt / 8 * MIN_SLOT_LOAD
+      && h->bucket_cnt > h->min_bucket_cnt)
+    swiss_rehash (h, ideal_size (h, h->elem_cnt));
+}
+
+/* Rebuilds HASH_SWISS table H with NEW_SLOT_CNT slots, which
+   must be enough to hold its elements, dropping its deleted
+   slots.  Returns true if successful, false if out of memory, in
+   which case H is unchanged. */
+static bool
+swiss_rehash (struct hash *h, size_t new_slot_cnt)
+{
+  struct hash_slot *old_slots = h->slots;
+  signed char *old_ctrl = h->ctrl;
+  size_t old_slot_cnt = h->bucket_cnt;
+  size_t i;
+
+  h->slots = calloc (new_slot_cnt, sizeof *h->slots);
+  h->ctrl = malloc (new_slot_cnt + GROUP_SIZE);
+  if (h->slots == NULL || h->ctrl == NULL)
+    {
+      free (h->slots);
+      free (h->ctrl);
+      h->slots = old_slots;
+      h->ctrl = old_ctrl;
+      return false;
+    }
+  h->bucket_cnt = new_slot_cnt;
+  swiss_clear_ctrl (h);
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      swiss_place (h, old_slots[i].elem, old_slots[i].hash);
+  free (old_slots);
+  free (old_ctrl);
+  return true;
+}
+
+/* Sizing. */
+
+/* Returns the least number of buckets or slots that a table of
+   the kind H is may have. */
+static size_t
+min_size (const struct hash *h)
+{
+  if (h->engine == HASH_OPEN)
+    return MIN_SLOTS;
+  if (h->engine == HASH_SWISS)
+    return GROUP_SIZE;
+  return 4;
+}
+
+/* Returns the number of buckets or slots that hash table H
+   should have to hold ELEM_CNT elements: the least power of 2,
+   and at least H->min_bucket_cnt, that leaves at most
+   BEST_ELEMS_PER_BUCKET elements per bucket, or leaves an
+   open-addressing table at most half full. */
+static size_t
+ideal_size (const struct hash *h, size_t elem_cnt)
+{
+  size_t want = (h->engine == HASH_CHAINED
+                 ? elem_cnt / BEST_ELEMS_PER_BUCKET : elem_cnt * 2);
+  size_t cnt;
+
+  for (cnt = h->min_bucket_cnt; cnt < want; cnt *= 2)
+    continue;
+  return cnt;
+}
+
+/* Changes the number of buckets or slots in hash table H to CNT,
+   a power of 2 that is enough to hold its elements, moving all
+   of them at once.  Returns true if successful, false if out of
+   memory, in which case H still holds all of its elements. */
+static bool
+resize (struct hash *h, size_t cnt)
+{
+  if (h->engine == HASH_OPEN)
+    return open_resize (h, cnt);
+  if (h->engine == HASH_SWISS)
+    return swiss_rehash (h, cnt);
+
+  if (h->old_buckets != NULL)
+    migrate (h, h->old_bucket_cnt);
+  if (cnt == h->bucket_cnt)
+    return true;
+  if (!start_rehash (h, cnt))
+    return false;
+  migrate (h, h->old_bucket_cnt);
+  return true;
+}
+
 unsigned hash_int_2(int i) {
     // 상수로 사용할 특정한 값 (예시로 0x45d9f3b를 사용하였습니다. 실제로는 다른 값으로 변경 가능)
     unsigned hash = 0x45d9f3b;
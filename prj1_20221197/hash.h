@@ -15,7 +15,31 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to ./list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   A table can instead be set up with hash_init_engine() to use
+   open addressing: the elements are kept in a flat array of
+   slots, each holding a pointer to an element and its hash
+   value, and an element that hashes to a full slot goes in the
+   next free one, with Robin Hood probing keeping every element
+   close to the slot it hashes to.  A lookup then reads one or
+   two cache lines of slots and only dereferences the elements
+   whose hash value matches, instead of following a pointer for
+   every element in a chain.
+
+   A third kind of table, also with open addressing, keeps a
+   control byte per slot besides the slots themselves, holding 7
+   bits of the hash value of the slot's element or marking the
+   slot empty or deleted.  A lookup compares the control bytes of
+   16 slots at a time against the hash bits it wants, using SSE2
+   where available, and looks at the elements only where those
+   match, so it rarely dereferences an element that is not the
+   one it is after, and can be kept fuller than a Robin Hood
+   table.
+
+   All kinds of table have the same interface; the struct
+   hash_elem is just not linked into a list in an open-addressing
+   table. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -26,6 +50,7 @@
 struct hash_elem 
   {
     struct list_elem list_elem;
+    unsigned hash;              /* Hash value, cached while in a table. */
   };
 
 /* Computes and returns the hash value for hash element E, given
@@ -43,12 +68,38 @@ typedef bool hash_less_func (const struct hash_elem *a,
    data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
+/* Ways of storing the elements of a hash table. */
+enum hash_engine
+  {
+    HASH_CHAINED,               /* A list of elements per bucket. */
+    HASH_OPEN,                  /* Open addressing, Robin Hood probing. */
+    HASH_SWISS                  /* Open addressing, control bytes probed
+                                   a group at a time. */
+  };
+
+/* Slot in an open-addressing hash table. */
+struct hash_slot
+  {
+    struct hash_elem *elem;     /* Element, or null if slot is empty. */
+    unsigned hash;              /* Hash value of `elem'. */
+  };
+
 /* Hash table. */
 struct hash 
   {
     size_t elem_cnt;            /* Number of elements in table. */
-    size_t bucket_cnt;          /* Number of buckets, a power of 2. */
-    struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    size_t bucket_cnt;          /* Number of buckets or slots, a power of 2. */
+    size_t min_bucket_cnt;      /* Never shrink to fewer buckets or slots. */
+    struct list *buckets;       /* HASH_CHAINED: array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* HASH_CHAINED: buckets being rehashed
+                                   into `buckets', or null. */
+    size_t old_bucket_cnt;      /* Number of old buckets. */
+    size_t migrate_idx;         /* Old buckets before this are empty. */
+    struct hash_slot *slots;    /* HASH_OPEN, HASH_SWISS: array of
+                                   `bucket_cnt' slots. */
+    signed char *ctrl;          /* HASH_SWISS: control byte per slot. */
+    size_t deleted_cnt;         /* HASH_SWISS: slots marked deleted. */
+    enum hash_engine engine;    /* How elements are stored. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -58,12 +109,17 @@ struct hash
 struct hash_iterator 
   {
     struct hash *hash;          /* The hash table. */
-    struct list *bucket;        /* Current bucket. */
+    struct list *bucket;        /* HASH_CHAINED: current bucket. */
+    size_t slot;                /* Index of current bucket or slot. */
     struct hash_elem *elem;     /* Current hash element in current bucket. */
   };
 
 /* Basic life cycle. */
 bool hash_init (struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_engine (struct hash *, enum hash_engine,
+                       hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_with_capacity (struct hash *, enum hash_engine, size_t capacity,
+                              hash_hash_func *, hash_less_func *, void *aux);
 void hash_clear (struct hash *, hash_action_func *);
 void hash_destroy (struct hash *, hash_action_func *);
 
@@ -83,6 +139,10 @@ struct hash_elem *hash_cur (struct hash_iterator *);
 size_t hash_size (struct hash *);
 bool hash_empty (struct hash *);
 
+/* Capacity. */
+bool hash_reserve (struct hash *, size_t cnt);
+void hash_shrink_to_fit (struct hash *);
+
 /* Sample hash functions. */
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
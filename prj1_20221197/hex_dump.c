@@ -1,8 +1,32 @@
 #include <stdio.h> 
 #include <ctype.h>
+#include <string.h>
 #include "hex_dump.h"
 #include "round.h"
 
+/* Output is collected in a buffer of this many bytes and written
+   with one fwrite() whenever it fills up, instead of with one
+   printf() per byte. */
+#define HEX_DUMP_BUF 4096
+
+/* Longest line hex_dump() prints: the offset, 16 bytes in hex,
+   16 ASCII characters between bars, and the new-line. */
+#define HEX_DUMP_LINE (16 + 2 + 16 * 3 + 1 + 16 + 1 + 1)
+
+/* Appends X to *P in hex, zero-padded to at least DIGITS digits
+   like printf's "%0*jx", advancing *P. */
+static void
+put_hex (char **p, uintmax_t x, int digits)
+{
+  static const char hex[] = "0123456789abcdef";
+  int i;
+
+  while (digits < (int) sizeof x * 2 && x >> (digits * 4) != 0)
+    digits++;
+  for (i = digits - 1; i >= 0; i--)
+    *(*p)++ = hex[(x >> (i * 4)) & 15];
+}
+
 /* Dumps the SIZE bytes in BUF to the console as hex bytes
    arranged 16 per line.  Numeric offsets are also included,
    starting at OFS for the first byte in BUF.  If ASCII is true
@@ -13,6 +37,8 @@ hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
 {
   const uint8_t *buf = buf__;
   const size_t per_line = 16; /* Maximum bytes per line. */
+  char out[HEX_DUMP_BUF];
+  char *p = out;
 
   while (size > 0)
     {
@@ -26,31 +52,48 @@ hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
         end = start + size;
       n = end - start;
 
-      /* Print line. */
-      printf ("%08jx  ", (uintmax_t) ROUND_DOWN (ofs, per_line));
+      /* Make room for the line. */
+      if (p + HEX_DUMP_LINE > out + sizeof out)
+        {
+          fwrite (out, 1, p - out, stdout);
+          p = out;
+        }
+
+      /* Format line. */
+      put_hex (&p, ROUND_DOWN (ofs, per_line), 8);
+      *p++ = ' ';
+      *p++ = ' ';
       for (i = 0; i < start; i++)
-        printf ("   ");
+        {
+          memcpy (p, "   ", 3);
+          p += 3;
+        }
       for (; i < end; i++) 
-        printf ("%02hhx%c",
-                buf[i - start], i == per_line / 2 - 1? '-' : ' ');
+        {
+          put_hex (&p, buf[i - start], 2);
+          *p++ = i == per_line / 2 - 1? '-' : ' ';
+        }
       if (ascii) 
         {
           for (; i < per_line; i++)
-            printf ("   ");
-          printf ("|");
+            {
+              memcpy (p, "   ", 3);
+              p += 3;
+            }
+          *p++ = '|';
           for (i = 0; i < start; i++)
-            printf (" ");
+            *p++ = ' ';
           for (; i < end; i++)
-            printf ("%c",
-                    isprint (buf[i - start]) ? buf[i - start] : '.');
+            *p++ = isprint (buf[i - start]) ? buf[i - start] : '.';
           for (; i < per_line; i++)
-            printf (" ");
-          printf ("|");
+            *p++ = ' ';
+          *p++ = '|';
         }
-      printf ("\n");
+      *p++ = '\n';
 
       ofs += n;
       buf += n;
       size -= n;
     }
+  fwrite (out, 1, p - out, stdout);
 }
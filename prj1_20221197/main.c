@@ -1,6 +1,7 @@
 #include "list.h"
 #include "hash.h"
 #include "bitmap.h"
+#include "buddy.h"
 #include "hex_dump.h"
 #include "round.h"
 #include "debug.h"
@@ -30,6 +31,7 @@ struct my_data
 struct bitmap *bitmap_list[MAX_SIZE];
 struct list *list_list[MAX_SIZE];
 struct hash *hash_tables[MAX_SIZE] = {NULL};
+struct buddy *buddy_list[MAX_SIZE];
 
 bool less(const struct list_elem *elem_a, const struct list_elem *elem_b, void *aux)
 {
@@ -59,7 +61,7 @@ bool hash_less_my_struct(const struct hash_elem *a, const struct hash_elem *b, v
     return a_->data < b_->data;
 }
 
-void create_hash(const char *name)
+void create_hash(const char *name, enum hash_engine engine)
 {
     int index = -1;
     if (sscanf(name, "hash%d", &index) == 1 && index >= 0 && index < MAX_SIZE)
@@ -71,7 +73,7 @@ void create_hash(const char *name)
             if (hash_tables[index] != NULL)
             {
                 // 해시 테이블 초기화 시 사용자 정의 해시 함수와 비교 함수 전달
-                if (hash_init(hash_tables[index], hash_my_struct, hash_less_my_struct, NULL))
+                if (hash_init_engine(hash_tables[index], engine, hash_my_struct, hash_less_my_struct, NULL))
                 {
                 }
                 else
@@ -131,6 +133,29 @@ void createBitmap(const char *name, size_t bit_cnt)
     }
 }
 
+void create_buddy(const char *name, size_t page_cnt)
+{
+    int index = -1;
+    // 이름에서 번호를 읽습니다. (예: buddy0)
+    if (sscanf(name, "buddy%d", &index) == 1 && index >= 0 && index < MAX_SIZE)
+    {
+        if (buddy_list[index] != NULL)
+        {
+            printf("A buddy allocator already exists at index %d. Please delete it before creating a new one.\n", index);
+            return;
+        }
+        buddy_list[index] = buddy_create(page_cnt);
+        if (buddy_list[index] == NULL)
+        {
+            printf("Failed to create buddy allocator %s.\n", name);
+        }
+    }
+    else
+    {
+        printf("Invalid buddy allocator name: %s. Expected format is 'buddyX'.\n", name);
+    }
+}
+
 void create_list(const char *name)
 {
     int index = -1;
@@ -199,18 +224,48 @@ void delete_list(struct list *my_list)
 
 void dumpdata_bitmap_binary(const struct bitmap *b)
 {
-    bool data_printed = false; // 데이터가 출력되었는지 여부를 추적
-
-    for (size_t i = 0; i < b->bit_cnt; ++i)
+    // 비트마다 printf를 부르는 대신 한 번에 0/1 문자열로 만들어 출력합니다.
+    if (bitmap_size(b) > 0)
     {
-        printf("%d", bitmap_test(b, i) ? 1 : 0);
-        data_printed = true; // 데이터 출력
+        bitmap_write(b, BITMAP_BINARY, stdout);
+        printf("\n"); // 데이터가 출력되었다면 개행 문자 출력
     }
+}
 
-    if (data_printed)
+// "binary", "hex", "raw" 문자열을 bitmap_format 값으로 바꿉니다. 알 수 없는 이름이면 false를 반환합니다.
+bool parse_bitmap_format(const char *name, enum bitmap_format *format)
+{
+    if (strcmp(name, "binary") == 0)
+        *format = BITMAP_BINARY;
+    else if (strcmp(name, "hex") == 0)
+        *format = BITMAP_HEX;
+    else if (strcmp(name, "raw") == 0)
+        *format = BITMAP_RAW;
+    else
+        return false;
+    return true;
+}
+
+// 공백으로 구분된 비트 번호들을 IDX에 최대 MAX개까지 읽어 들이고 읽은 개수를 반환합니다.
+// 숫자가 아닌 값이 있거나 MAX개를 넘으면 SIZE_MAX를 반환합니다.
+size_t parse_index_list(const char *text, size_t *idx, size_t max)
+{
+    size_t n = 0;
+    int consumed;
+    size_t value;
+
+    while (sscanf(text, "%zu%n", &value, &consumed) == 1)
     {
-        printf("\n"); // 데이터가 출력되었다면 개행 문자 출력
+        if (n == max)
+            return SIZE_MAX;
+        idx[n++] = value;
+        text += consumed;
     }
+
+    // 남은 문자가 공백뿐이어야 올바른 목록입니다.
+    while (*text == ' ' || *text == '\t' || *text == '\n')
+        text++;
+    return *text == '\0' ? n : SIZE_MAX;
 }
 
 void dumpdata_list(const struct list *list)
@@ -232,25 +287,21 @@ void dumpdata_list(const struct list *list)
     }
 }
 
-void dumpdata_hash(const struct hash *h)
+void dumpdata_hash(struct hash *h)
 {
     bool data_printed = false; // 데이터가 출력되었는지 여부를 추적하는 플래그
+    struct hash_iterator i;
 
-    for (size_t i = 0; i < h->bucket_cnt; i++)
-    { // 모든 버킷 순회
-        struct list *bucket = &h->buckets[i];
-        struct list_elem *e;
-
-        for (e = list_begin(bucket); e != list_end(bucket); e = list_next(e))
-        {
-            // 현재 요소를 구조체로 변환
-            struct hash_elem *hash_e = list_entry(e, struct hash_elem, list_elem);
-            struct my_struct *item = hash_entry(hash_e, struct my_struct, elem);
+    // 저장 방식과 상관없이 반복자로 모든 요소를 순회합니다.
+    hash_first(&i, h);
+    while (hash_next(&i))
+    {
+        // 현재 요소를 구조체로 변환
+        struct my_struct *item = hash_entry(hash_cur(&i), struct my_struct, elem);
 
-            // 데이터 출력
-            printf("%d ", item->data);
-            data_printed = true; // 데이터를 출력했으므로 플래그를 true로 설정
-        }
+        // 데이터 출력
+        printf("%d ", item->data);
+        data_printed = true; // 데이터를 출력했으므로 플래그를 true로 설정
     }
 
     if (data_printed)
@@ -279,20 +330,17 @@ void triple(struct hash_elem *e, void *aux)
 // 찾지 못한 경우 NULL을 반환합니다.
 struct hash_elem *find_hash_elem_by_value(struct hash *h, int data_value)
 {
-    // 해시 테이블의 모든 버킷을 순회
-    for (size_t i = 0; i < h->bucket_cnt; ++i)
+    struct hash_iterator i;
+
+    // 해시 테이블의 모든 요소를 순회
+    hash_first(&i, h);
+    while (hash_next(&i))
     {
-        struct list *bucket = &h->buckets[i];
-        // 각 버킷 내의 모든 요소를 순회
-        for (struct list_elem *e = list_begin(bucket); e != list_end(bucket); e = list_next(e))
+        struct my_struct *item = hash_entry(hash_cur(&i), struct my_struct, elem);
+        // data_value와 일치하는 요소를 찾으면 반환
+        if (item->data == data_value)
         {
-            struct hash_elem *he = list_entry(e, struct hash_elem, list_elem);
-            struct my_struct *item = hash_entry(he, struct my_struct, elem);
-            // data_value와 일치하는 요소를 찾으면 반환
-            if (item->data == data_value)
-            {
-                return he;
-            }
+            return hash_cur(&i);
         }
     }
     // 찾지 못한 경우
@@ -335,6 +383,47 @@ struct list_elem *list_nth_elem(struct list *list, int n)
 
 /*list_unique*/
 
+/*bitmap 집합 연산*/
+// 명령어 이름(bitmap_and 등)에 맞는 집합 연산을 수행합니다. dst는 a나 b와 같아도 됩니다.
+bool combine_bitmaps(const char *command, struct bitmap *dst, const struct bitmap *a, const struct bitmap *b)
+{
+    if (strcmp(command, "bitmap_and") == 0)
+        bitmap_and(dst, a, b);
+    else if (strcmp(command, "bitmap_or") == 0)
+        bitmap_or(dst, a, b);
+    else if (strcmp(command, "bitmap_xor") == 0)
+        bitmap_xor(dst, a, b);
+    else if (strcmp(command, "bitmap_andnot") == 0)
+        bitmap_andnot(dst, a, b);
+    else
+        return false;
+    return true;
+}
+
+// 명령어 이름(bitmap_and_count 등)에 맞는 집합 연산 결과의 1 비트 개수를 반환합니다.
+size_t count_combined_bitmaps(const char *command, const struct bitmap *a, const struct bitmap *b)
+{
+    if (strcmp(command, "bitmap_and_count") == 0)
+        return bitmap_and_count(a, b);
+    else if (strcmp(command, "bitmap_or_count") == 0)
+        return bitmap_or_count(a, b);
+    else if (strcmp(command, "bitmap_xor_count") == 0)
+        return bitmap_xor_count(a, b);
+    else
+        return bitmap_andnot_count(a, b);
+}
+
+// 비트맵 인덱스가 유효하고 비트맵이 생성되어 있는지 확인합니다.
+bool valid_bitmap_index(int index)
+{
+    return index >= 0 && index < MAX_SIZE && bitmap_list[index] != NULL;
+}
+
+bool valid_buddy_index(int index)
+{
+    return index >= 0 && index < MAX_SIZE && buddy_list[index] != NULL;
+}
+
 int main()
 {
     // initializeBitmapList();
@@ -370,7 +459,11 @@ int main()
 
         else if (strcmp(command, "create") == 0 && sscanf(line, "%*s %s %s %zu", type, structName, &bit_cnt) == 3)
         {
-            createBitmap(structName, bit_cnt);
+            // create buddy buddy0 64 는 64쪽짜리 버디 할당기를 만듭니다.
+            if (strcmp(type, "buddy") == 0)
+                create_buddy(structName, bit_cnt);
+            else
+                createBitmap(structName, bit_cnt);
         }
 
         else if (strcmp(command, "create") == 0 && sscanf(line, "%*s %s %s", type, structName) == 2)
@@ -381,7 +474,22 @@ int main()
             }
             else if (strcmp(type, "hashtable") == 0)
             {
-                create_hash(structName);
+                // create hashtable hash0 open 처럼 저장 방식을 고를 수 있습니다. 기본은 체이닝입니다.
+                char engine_str[16];
+                enum hash_engine engine = HASH_CHAINED;
+                if (sscanf(line, "%*s %*s %*s %15s", engine_str) == 1)
+                {
+                    if (strcmp(engine_str, "open") == 0)
+                        engine = HASH_OPEN;
+                    else if (strcmp(engine_str, "swiss") == 0)
+                        engine = HASH_SWISS;
+                    else if (strcmp(engine_str, "chained") != 0)
+                    {
+                        printf("Invalid hash engine. Use 'chained', 'open' or 'swiss'.\n");
+                        continue;
+                    }
+                }
+                create_hash(structName, engine);
             }
         }
         else if (strcmp(command, "delete") == 0 && sscanf(line, "%*s bm%d", &bit_index) == 1)
@@ -403,6 +511,18 @@ int main()
                 printf("Error: Bitmap index %d is out of bounds.\n", bit_index);
             }
         }
+        else if (strcmp(command, "delete") == 0 && sscanf(line, "%*s buddy%d", &int_value) == 1)
+        {
+            if (valid_buddy_index(int_value))
+            {
+                buddy_destroy(buddy_list[int_value]);
+                buddy_list[int_value] = NULL;
+            }
+            else
+            {
+                printf("Error: No buddy allocator at index %d to delete.\n", int_value);
+            }
+        }
         else if (strcmp(command, "delete") == 0 && sscanf(line, "%*s list%d", &list_index) == 1)
         {
             // list_index의 유효성 검사
@@ -507,6 +627,59 @@ int main()
             printf("%s\n", result ? "true" : "false");
         }
 
+        // bitmap_set_batch bm0 true 3 17 9 는 나열된 비트들을 한 번에 설정합니다.
+        else if (strcmp(command, "bitmap_set_batch") == 0)
+        {
+            char value_str[6];
+            size_t indices[512], n = SIZE_MAX, i;
+            int consumed = 0;
+            if (sscanf(line, "%*s bm%d %5s %n", &bit_index, value_str, &consumed) == 2 && consumed > 0 &&
+                valid_bitmap_index(bit_index) && (strcmp(value_str, "true") == 0 || strcmp(value_str, "false") == 0))
+            {
+                n = parse_index_list(line + consumed, indices, 512);
+            }
+            for (i = 0; n != SIZE_MAX && i < n; i++)
+            {
+                if (indices[i] >= bitmap_size(bitmap_list[bit_index]))
+                    n = SIZE_MAX;
+            }
+            if (n != SIZE_MAX)
+            {
+                bitmap_set_batch(bitmap_list[bit_index], indices, n, strcmp(value_str, "true") == 0);
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        // bitmap_test_batch bm0 3 17 9 는 나열된 비트마다 true/false를 한 줄씩 출력합니다.
+        else if (strcmp(command, "bitmap_test_batch") == 0)
+        {
+            size_t indices[512], n = SIZE_MAX, i;
+            bool results[512];
+            int consumed = 0;
+            if (sscanf(line, "%*s bm%d %n", &bit_index, &consumed) == 1 && consumed > 0 && valid_bitmap_index(bit_index))
+            {
+                n = parse_index_list(line + consumed, indices, 512);
+            }
+            for (i = 0; n != SIZE_MAX && i < n; i++)
+            {
+                if (indices[i] >= bitmap_size(bitmap_list[bit_index]))
+                    n = SIZE_MAX;
+            }
+            if (n != SIZE_MAX)
+            {
+                bitmap_test_batch(bitmap_list[bit_index], indices, n, results);
+                for (i = 0; i < n; i++)
+                    printf("%s\n", results[i] ? "true" : "false");
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
         else if (strcmp(command, "bitmap_set_all") == 0)
         {
             char value_str[6]; // "true" 또는 "false" 문자열을 저장할 배열
@@ -711,11 +884,220 @@ int main()
             }
         }
 
+        // bitmap_scan_policy bm0 0 4 false next 처럼 마지막에 first, next, best 중 하나를 줍니다.
+        else if (strcmp(command, "bitmap_scan_policy") == 0)
+        {
+            char value_str[6], policy_str[6];
+            if (sscanf(line, "%*s bm%d %zu %zu %5s %5s", &bit_index, &start, &cnt, value_str, policy_str) == 5 &&
+                valid_bitmap_index(bit_index) && start <= bitmap_size(bitmap_list[bit_index]) &&
+                (strcmp(value_str, "true") == 0 || strcmp(value_str, "false") == 0))
+            {
+                enum bitmap_policy policy;
+                if (strcmp(policy_str, "first") == 0)
+                {
+                    policy = BITMAP_FIRST_FIT;
+                }
+                else if (strcmp(policy_str, "next") == 0)
+                {
+                    policy = BITMAP_NEXT_FIT;
+                }
+                else if (strcmp(policy_str, "best") == 0)
+                {
+                    // 가장 알맞은 빈 구간을 빨리 찾도록 구간 색인을 붙입니다.
+                    policy = BITMAP_BEST_FIT;
+                    bitmap_enable_runs(bitmap_list[bit_index]);
+                }
+                else
+                {
+                    printf("Invalid policy. Use 'first', 'next' or 'best'.\n");
+                    continue;
+                }
+
+                printf("%zu\n", bitmap_scan_policy(bitmap_list[bit_index], start, cnt, strcmp(value_str, "true") == 0, policy));
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        // bitmap_and bm0 bm1 은 bm0 &= bm1, bitmap_and bm0 bm1 bm2 는 bm0 = bm1 & bm2 입니다.
+        else if (strcmp(command, "bitmap_and") == 0 || strcmp(command, "bitmap_or") == 0 ||
+                 strcmp(command, "bitmap_xor") == 0 || strcmp(command, "bitmap_andnot") == 0)
+        {
+            int dst_index, a_index, b_index;
+            int n = sscanf(line, "%*s bm%d bm%d bm%d", &dst_index, &a_index, &b_index);
+            if (n == 2)
+            {
+                // 두 개만 주어지면 제자리 연산입니다.
+                b_index = a_index;
+                a_index = dst_index;
+            }
+            if (n >= 2 && valid_bitmap_index(dst_index) && valid_bitmap_index(a_index) && valid_bitmap_index(b_index))
+            {
+                if (bitmap_size(bitmap_list[dst_index]) == bitmap_size(bitmap_list[a_index]) &&
+                    bitmap_size(bitmap_list[a_index]) == bitmap_size(bitmap_list[b_index]))
+                {
+                    combine_bitmaps(command, bitmap_list[dst_index], bitmap_list[a_index], bitmap_list[b_index]);
+                }
+                else
+                {
+                    printf("Bitmaps must have the same size.\n");
+                }
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        else if (strcmp(command, "bitmap_and_count") == 0 || strcmp(command, "bitmap_or_count") == 0 ||
+                 strcmp(command, "bitmap_xor_count") == 0 || strcmp(command, "bitmap_andnot_count") == 0)
+        {
+            int a_index, b_index;
+            if (sscanf(line, "%*s bm%d bm%d", &a_index, &b_index) == 2 && valid_bitmap_index(a_index) && valid_bitmap_index(b_index))
+            {
+                if (bitmap_size(bitmap_list[a_index]) == bitmap_size(bitmap_list[b_index]))
+                {
+                    printf("%zu\n", count_combined_bitmaps(command, bitmap_list[a_index], bitmap_list[b_index]));
+                }
+                else
+                {
+                    printf("Bitmaps must have the same size.\n");
+                }
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        // bitmap_stats bm0 [region_bits] 는 채움 정도와 빈 구간(false 비트 구간)의 분포를 출력합니다.
+        // 영역 크기를 주면 영역마다 true 비트 수도 함께 출력합니다.
+        else if (strcmp(command, "bitmap_stats") == 0)
+        {
+            size_t region_bits = 0;
+            int n = sscanf(line, "%*s bm%d %zu", &bit_index, &region_bits);
+            if (n >= 1 && valid_bitmap_index(bit_index) && (n == 1 || region_bits > 0))
+            {
+                struct bitmap *b = bitmap_list[bit_index];
+                struct bitmap_stats stats;
+                size_t *region_set = NULL;
+                size_t region_cnt = 0, i;
+
+                if (region_bits > 0)
+                {
+                    region_cnt = (bitmap_size(b) + region_bits - 1) / region_bits;
+                    region_set = malloc((region_cnt > 0 ? region_cnt : 1) * sizeof *region_set);
+                    if (region_set == NULL)
+                    {
+                        printf("Failed to allocate memory for region counts.\n");
+                        continue;
+                    }
+                }
+                bitmap_stats(b, &stats, region_bits, region_set);
+
+                printf("set %zu\n", stats.set_cnt);
+                printf("clear %zu\n", stats.clear_cnt);
+                printf("free_runs %zu\n", stats.free_run_cnt);
+                printf("largest_free_run %zu\n", stats.largest_free_run);
+                // 빈 구간이 있는 구간 길이 대역만 출력합니다. 마지막 대역은 그보다 긴 구간도 포함합니다.
+                for (i = 0; i < BITMAP_STATS_BUCKETS; i++)
+                {
+                    if (stats.free_run_hist[i] > 0)
+                        printf("free_run_len %zu%s %zu\n", (size_t) 1 << i,
+                               i == BITMAP_STATS_BUCKETS - 1 ? "+" : "", stats.free_run_hist[i]);
+                }
+                if (region_set != NULL)
+                {
+                    printf("regions");
+                    for (i = 0; i < region_cnt; i++)
+                        printf(" %zu", region_set[i]);
+                    printf("\n");
+                    free(region_set);
+                }
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
         else if (strcmp(command, "bitmap_size") == 0 && sscanf(line, "%*s bm%d", &bit_index) == 1)
         {
             printf("%zu\n", bitmap_size(bitmap_list[bit_index]));
         }
 
+        else if (strcmp(command, "bitmap_rank") == 0)
+        {
+            if (sscanf(line, "%*s bm%d %zu", &bit_index, &idx) == 2 && valid_bitmap_index(bit_index) && idx <= bitmap_size(bitmap_list[bit_index]))
+            {
+                // 순위 색인은 처음 쓸 때 붙여 두고, 이후 변경에 맞춰 필요한 부분만 다시 계산됩니다.
+                bitmap_enable_rank(bitmap_list[bit_index]);
+                printf("%zu\n", bitmap_rank(bitmap_list[bit_index], idx));
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        else if (strcmp(command, "bitmap_select") == 0)
+        {
+            if (sscanf(line, "%*s bm%d %zu", &bit_index, &idx) == 2 && valid_bitmap_index(bit_index))
+            {
+                bitmap_enable_rank(bitmap_list[bit_index]);
+                printf("%zu\n", bitmap_select(bitmap_list[bit_index], idx));
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        // bitmap_encode bm0 hex 는 bm0를 주어진 형식으로 한 줄에 출력합니다.
+        else if (strcmp(command, "bitmap_encode") == 0)
+        {
+            char format_str[8];
+            enum bitmap_format format;
+            if (sscanf(line, "%*s bm%d %7s", &bit_index, format_str) == 2 && valid_bitmap_index(bit_index) &&
+                parse_bitmap_format(format_str, &format) && format != BITMAP_RAW)
+            {
+                bitmap_write(bitmap_list[bit_index], format, stdout);
+                printf("\n");
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        // bitmap_load bm0 12 hex 0f3a 는 12비트짜리 bm0를 주어진 데이터로 새로 만듭니다.
+        else if (strcmp(command, "bitmap_load") == 0)
+        {
+            char format_str[8], data[1024];
+            enum bitmap_format format;
+            if (sscanf(line, "%*s bm%d %zu %7s %1023s", &bit_index, &bit_cnt, format_str, data) == 4 &&
+                bit_index >= 0 && bit_index < MAX_SIZE && parse_bitmap_format(format_str, &format) && format != BITMAP_RAW)
+            {
+                struct bitmap *loaded = bitmap_decode(data, strlen(data), bit_cnt, format);
+                if (loaded != NULL)
+                {
+                    // 기존 비트맵이 있었다면 파괴하고 새 비트맵으로 바꿉니다.
+                    bitmap_destroy(bitmap_list[bit_index]);
+                    bitmap_list[bit_index] = loaded;
+                }
+                else
+                {
+                    printf("Failed to load bitmap.\n");
+                }
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
         else if (strcmp(command, "bitmap_expand") == 0)
         {
             if (sscanf(line, "%*s bm%d %d", &bit_index, &size) == 2)
@@ -737,6 +1119,62 @@ int main()
             }
         }
 
+        else if (strcmp(command, "bitmap_shrink") == 0)
+        {
+            if (sscanf(line, "%*s bm%d %zu", &bit_index, &size) == 2 && valid_bitmap_index(bit_index) &&
+                size <= bitmap_size(bitmap_list[bit_index]))
+            {
+                // 뒤쪽 size개의 비트를 잘라 냅니다.
+                bitmap_shrink(bitmap_list[bit_index], bitmap_size(bitmap_list[bit_index]) - size);
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        else if (strcmp(command, "buddy_alloc") == 0)
+        {
+            if (sscanf(line, "%*s buddy%d %d", &int_value, &position) == 2 && valid_buddy_index(int_value) &&
+                position >= 0 && position <= buddy_max_order(buddy_list[int_value]))
+            {
+                // 할당한 첫 쪽 번호를 출력합니다. 빈 구간이 없으면 BITMAP_ERROR가 출력됩니다.
+                printf("%zu\n", buddy_alloc(buddy_list[int_value], position));
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        else if (strcmp(command, "buddy_free") == 0)
+        {
+            if (sscanf(line, "%*s buddy%d %zu %d", &int_value, &idx, &position) == 3 && valid_buddy_index(int_value) &&
+                position >= 0 && position <= buddy_max_order(buddy_list[int_value]) &&
+                idx % ((size_t) 1 << position) == 0 && idx < buddy_size(buddy_list[int_value]) &&
+                ((size_t) 1 << position) <= buddy_size(buddy_list[int_value]) - idx)
+            {
+                // 할당할 때와 같은 차수로 돌려주어야 하며, 짝이 비어 있으면 합쳐집니다.
+                buddy_free(buddy_list[int_value], idx, position);
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
+        else if (strcmp(command, "buddy_free_pages") == 0)
+        {
+            if (sscanf(line, "%*s buddy%d", &int_value) == 1 && valid_buddy_index(int_value))
+            {
+                printf("%zu\n", buddy_free_pages(buddy_list[int_value]));
+            }
+            else
+            {
+                printf("Invalid command format.\n");
+            }
+        }
+
         else if (strcmp(command, "hash_insert") == 0 && sscanf(line, "%*s hash%d %d", &hash_index, &data_value) == 2)
         {
             // 새로운 my_struct 인스턴스를 생성하고 초기화
@@ -887,6 +1325,30 @@ int main()
                 printf("Invalid hash table index or uninitialized hash table.\n");
             }
         }
+        else if (strcmp(command, "hash_reserve") == 0 && sscanf(line, "%*s hash%d %zu", &hash_index, &cnt) == 2)
+        {
+            if (hash_index >= 0 && hash_index < MAX_SIZE && hash_tables[hash_index] != NULL)
+            {
+                // 메모리가 부족하면 테이블은 그대로 남는다
+                if (!hash_reserve(hash_tables[hash_index], cnt))
+                    printf("Out of memory.\n");
+            }
+            else
+            {
+                printf("Invalid hash table index or uninitialized hash table.\n");
+            }
+        }
+        else if (strcmp(command, "hash_shrink_to_fit") == 0 && sscanf(line, "%*s hash%d", &hash_index) == 1)
+        {
+            if (hash_index >= 0 && hash_index < MAX_SIZE && hash_tables[hash_index] != NULL)
+            {
+                hash_shrink_to_fit(hash_tables[hash_index]);
+            }
+            else
+            {
+                printf("Invalid hash table index or uninitialized hash table.\n");
+            }
+        }
 
         else if (strcmp(command, "list_push_back") == 0 && sscanf(line, "%*s list%d %d", &list_index, &data_value) == 2)
         {
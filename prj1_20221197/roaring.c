@@ -0,0 +1,1222 @@
+/* Compressed bitmap.
+
+   See roaring.h for basic information. */
+
+#include "roaring.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "round.h"
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Number of bits in a chunk, and of 64-bit words in a bitset
+   container. */
+#define CHUNK_BITS 65536
+#define CHUNK_WORDS (CHUNK_BITS / 64)
+
+/* Largest number of values an array container holds.  Beyond
+   this a bitset container is smaller. */
+#define ARRAY_MAX 4096
+
+/* Largest number of runs a run container holds, for the same
+   reason. */
+#define RUN_MAX 2048
+
+/* Kinds of container. */
+enum container_type
+  {
+    ARRAY_CONTAINER,            /* Sorted array of values. */
+    BITSET_CONTAINER,           /* CHUNK_WORDS words of bits. */
+    RUN_CONTAINER               /* Sorted array of runs. */
+  };
+
+/* A run of consecutive set bits, START through LAST inclusive.
+   Runs in a run container are sorted, disjoint, and never
+   adjacent to one another. */
+struct run
+  {
+    uint16_t start;
+    uint16_t last;
+  };
+
+/* One chunk of a roaring bitmap.  Only chunks with at least one
+   bit set have a container. */
+struct container
+  {
+    size_t key;                 /* Index of the chunk. */
+    enum container_type type;
+    uint32_t card;              /* Number of bits set, at least 1. */
+    uint32_t len;               /* Values or runs in use. */
+    uint32_t cap;               /* Values or runs allocated. */
+    union
+      {
+        uint16_t *values;       /* ARRAY_CONTAINER. */
+        uint64_t *words;        /* BITSET_CONTAINER. */
+        struct run *runs;       /* RUN_CONTAINER. */
+      }
+    u;
+  };
+
+/* Roaring bitmap. */
+struct roaring
+  {
+    size_t bit_cnt;             /* Number of bits. */
+    size_t chunk_cnt;           /* Number of containers in use. */
+    size_t chunk_cap;           /* Number of containers allocated. */
+    struct container *chunks;   /* Containers, sorted by key. */
+  };
+
+/* Returns the chunk that contains bit IDX. */
+static inline size_t
+chunk_key (size_t idx)
+{
+  return idx / CHUNK_BITS;
+}
+
+/* Returns the position of bit IDX within its chunk. */
+static inline uint32_t
+chunk_low (size_t idx)
+{
+  return idx % CHUNK_BITS;
+}
+
+/* Returns a mask with bits LO through HI - 1 of a 64-bit word
+   set, for 0 <= LO < HI <= 64. */
+static inline uint64_t
+word_range_mask (unsigned lo, unsigned hi)
+{
+  uint64_t high = hi == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << hi) - 1;
+  return high & (~(uint64_t) 0 << lo);
+}
+
+/* Sets bits LO through HI - 1 in the bitset WORDS to VALUE. */
+static void
+words_set_range (uint64_t *words, uint32_t lo, uint32_t hi, bool value)
+{
+  while (lo < hi)
+    {
+      uint32_t w = lo / 64;
+      uint32_t end = hi < (w + 1) * 64 ? hi : (w + 1) * 64;
+      uint64_t mask = word_range_mask (lo % 64, end - w * 64);
+
+      if (value)
+        words[w] |= mask;
+      else
+        words[w] &= ~mask;
+      lo = end;
+    }
+}
+
+/* Container operations. */
+
+/* Returns the index of the first value in array container C that
+   is at least X, or C->len if there is none. */
+static uint32_t
+array_lower_bound (const struct container *c, uint32_t x)
+{
+  uint32_t lo = 0, hi = c->len;
+
+  while (lo < hi)
+    {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (c->u.values[mid] < x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the number of runs in run container C that start at or
+   before X.  The run that could contain X, if any, is the one
+   just before the returned index. */
+static uint32_t
+run_upper_bound (const struct container *c, uint32_t x)
+{
+  uint32_t lo = 0, hi = c->len;
+
+  while (lo < hi)
+    {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (c->u.runs[mid].start <= x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Makes room for at least CNT entries of SIZE bytes each in the
+   array or run container C.  Returns true if successful, false
+   if memory allocation failed. */
+static bool
+reserve_entries (struct container *c, uint32_t cnt, size_t size)
+{
+  void *data;
+  uint32_t cap;
+
+  if (cnt <= c->cap)
+    return true;
+  cap = c->cap < 4 ? 4 : c->cap * 2;
+  if (cap < cnt)
+    cap = cnt;
+  data = realloc (c->u.values, cap * size);
+  if (data == NULL)
+    return false;
+  c->u.values = data;
+  c->cap = cap;
+  return true;
+}
+
+/* Returns true if bit X is set in container C. */
+static bool
+container_test (const struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      i = array_lower_bound (c, x);
+      return i < c->len && c->u.values[i] == x;
+    case BITSET_CONTAINER:
+      return (c->u.words[x / 64] >> (x % 64)) & 1;
+    default:
+      i = run_upper_bound (c, x);
+      return i > 0 && c->u.runs[i - 1].last >= x;
+    }
+}
+
+/* Expands container C into the bitset WORDS. */
+static void
+container_to_words (const struct container *c, uint64_t *words)
+{
+  uint32_t i;
+
+  if (c->type == BITSET_CONTAINER)
+    {
+      memcpy (words, c->u.words, CHUNK_WORDS * sizeof *words);
+      return;
+    }
+
+  memset (words, 0, CHUNK_WORDS * sizeof *words);
+  if (c->type == ARRAY_CONTAINER)
+    for (i = 0; i < c->len; i++)
+      words[c->u.values[i] / 64] |= (uint64_t) 1 << (c->u.values[i] % 64);
+  else
+    for (i = 0; i < c->len; i++)
+      words_set_range (words, c->u.runs[i].start,
+                       (uint32_t) c->u.runs[i].last + 1, true);
+}
+
+/* Replaces the contents of container C by the bits in WORDS,
+   choosing the smallest kind of container for them.  WORDS must
+   have at least one bit set and must not be C's own storage.
+   Returns true if successful, false if memory allocation failed,
+   in which case C is unchanged. */
+static bool
+container_from_words (struct container *c, const uint64_t *words)
+{
+  uint32_t card = 0, nruns = 0;
+  uint64_t carry = 0;
+  size_t array_bytes, run_bytes, bitset_bytes;
+  struct container new;
+  uint32_t i;
+
+  /* A run starts wherever a bit is set and the bit below it is
+     not. */
+  for (i = 0; i < CHUNK_WORDS; i++)
+    {
+      uint64_t w = words[i];
+      card += __builtin_popcountll (w);
+      nruns += __builtin_popcountll (w & ~((w << 1) | carry));
+      carry = w >> 63;
+    }
+  ASSERT (card > 0);
+
+  array_bytes = card <= ARRAY_MAX ? card * sizeof (uint16_t) : SIZE_MAX;
+  run_bytes = nruns <= RUN_MAX ? nruns * sizeof (struct run) : SIZE_MAX;
+  bitset_bytes = CHUNK_WORDS * sizeof (uint64_t);
+
+  new.key = c->key;
+  new.card = card;
+  if (run_bytes < array_bytes && run_bytes < bitset_bytes)
+    {
+      uint32_t x = 0, r = 0;
+
+      new.type = RUN_CONTAINER;
+      new.len = new.cap = nruns;
+      new.u.runs = malloc (nruns * sizeof (struct run));
+      if (new.u.runs == NULL)
+        return false;
+      while (r < nruns)
+        {
+          /* Find the next set bit, then the next clear one. */
+          while (!((words[x / 64] >> (x % 64)) & 1))
+            x++;
+          new.u.runs[r].start = x;
+          while (x < CHUNK_BITS && ((words[x / 64] >> (x % 64)) & 1))
+            x++;
+          new.u.runs[r++].last = x - 1;
+        }
+    }
+  else if (array_bytes < bitset_bytes)
+    {
+      uint32_t n = 0;
+
+      new.type = ARRAY_CONTAINER;
+      new.len = new.cap = card;
+      new.u.values = malloc (card * sizeof (uint16_t));
+      if (new.u.values == NULL)
+        return false;
+      for (i = 0; i < CHUNK_WORDS; i++)
+        {
+          uint64_t w = words[i];
+          while (w != 0)
+            {
+              new.u.values[n++] = i * 64 + __builtin_ctzll (w);
+              w &= w - 1;
+            }
+        }
+    }
+  else
+    {
+      new.type = BITSET_CONTAINER;
+      new.len = new.cap = 0;
+      new.u.words = malloc (bitset_bytes);
+      if (new.u.words == NULL)
+        return false;
+      memcpy (new.u.words, words, bitset_bytes);
+    }
+
+  free (c->u.values);
+  *c = new;
+  return true;
+}
+
+/* Sets bit X in container C to true.  Returns true if
+   successful, false if memory allocation failed. */
+static bool
+container_add (struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  if (container_test (c, x))
+    return true;
+
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      if (c->len == ARRAY_MAX)
+        break;
+      if (!reserve_entries (c, c->len + 1, sizeof (uint16_t)))
+        return false;
+      i = array_lower_bound (c, x);
+      memmove (&c->u.values[i + 1], &c->u.values[i],
+               (c->len - i) * sizeof (uint16_t));
+      c->u.values[i] = x;
+      c->len++;
+      c->card++;
+      return true;
+
+    case BITSET_CONTAINER:
+      c->u.words[x / 64] |= (uint64_t) 1 << (x % 64);
+      c->card++;
+      return true;
+
+    case RUN_CONTAINER:
+      {
+        bool joins_prev, joins_next;
+
+        i = run_upper_bound (c, x);
+        joins_prev = i > 0 && (uint32_t) c->u.runs[i - 1].last + 1 == x;
+        joins_next = i < c->len && c->u.runs[i].start == x + 1;
+        if (joins_prev && joins_next)
+          {
+            c->u.runs[i - 1].last = c->u.runs[i].last;
+            memmove (&c->u.runs[i], &c->u.runs[i + 1],
+                     (c->len - i - 1) * sizeof (struct run));
+            c->len--;
+          }
+        else if (joins_prev)
+          c->u.runs[i - 1].last = x;
+        else if (joins_next)
+          c->u.runs[i].start = x;
+        else
+          {
+            if (c->len == RUN_MAX)
+              break;
+            if (!reserve_entries (c, c->len + 1, sizeof (struct run)))
+              return false;
+            memmove (&c->u.runs[i + 1], &c->u.runs[i],
+                     (c->len - i) * sizeof (struct run));
+            c->u.runs[i].start = c->u.runs[i].last = x;
+            c->len++;
+          }
+        c->card++;
+        return true;
+      }
+    }
+
+  /* The container is full for its kind, so re-encode it. */
+  {
+    uint64_t words[CHUNK_WORDS];
+
+    container_to_words (c, words);
+    words[x / 64] |= (uint64_t) 1 << (x % 64);
+    return container_from_words (c, words);
+  }
+}
+
+/* Sets bit X in container C to false.  Returns true if
+   successful, false if memory allocation failed.  C must not
+   become empty; the caller deletes containers instead. */
+static bool
+container_remove (struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  if (!container_test (c, x))
+    return true;
+  ASSERT (c->card > 1);
+
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      i = array_lower_bound (c, x);
+      memmove (&c->u.values[i], &c->u.values[i + 1],
+               (c->len - i - 1) * sizeof (uint16_t));
+      c->len--;
+      c->card--;
+      return true;
+
+    case BITSET_CONTAINER:
+      c->u.words[x / 64] &= ~((uint64_t) 1 << (x % 64));
+      c->card--;
+      if (c->card <= ARRAY_MAX / 2)
+        {
+          /* Shrink to an array or run container once the bitset
+             is clearly the wrong choice, but not right at the
+             boundary, so that adding and removing the same bit
+             does not re-encode every time. */
+          uint64_t words[CHUNK_WORDS];
+          memcpy (words, c->u.words, sizeof words);
+          if (!container_from_words (c, words))
+            {
+              c->u.words[x / 64] |= (uint64_t) 1 << (x % 64);
+              c->card++;
+              return false;
+            }
+        }
+      return true;
+
+    default:
+      {
+        struct run *r;
+
+        i = run_upper_bound (c, x) - 1;
+        r = &c->u.runs[i];
+        if (r->start == r->last)
+          {
+            memmove (r, r + 1, (c->len - i - 1) * sizeof (struct run));
+            c->len--;
+          }
+        else if (r->start == x)
+          r->start++;
+        else if (r->last == x)
+          r->last--;
+        else
+          {
+            /* Split the run in two. */
+            uint16_t last = r->last;
+
+            if (c->len == RUN_MAX
+                || !reserve_entries (c, c->len + 1, sizeof (struct run)))
+              {
+                uint64_t words[CHUNK_WORDS];
+
+                container_to_words (c, words);
+                words[x / 64] &= ~((uint64_t) 1 << (x % 64));
+                return container_from_words (c, words);
+              }
+            r = &c->u.runs[i];
+            memmove (r + 2, r + 1, (c->len - i - 1) * sizeof (struct run));
+            r[0].last = x - 1;
+            r[1].start = x + 1;
+            r[1].last = last;
+            c->len++;
+          }
+        c->card--;
+        return true;
+      }
+    }
+}
+
+/* Returns the number of bits set in container C from LO through
+   HI - 1. */
+static uint32_t
+container_count (const struct container *c, uint32_t lo, uint32_t hi)
+{
+  uint32_t cnt = 0;
+  uint32_t i;
+
+  if (lo >= hi)
+    return 0;
+  if (lo == 0 && hi == CHUNK_BITS)
+    return c->card;
+
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      return array_lower_bound (c, hi) - array_lower_bound (c, lo);
+
+    case BITSET_CONTAINER:
+      while (lo < hi)
+        {
+          uint32_t w = lo / 64;
+          uint32_t end = hi < (w + 1) * 64 ? hi : (w + 1) * 64;
+          cnt += __builtin_popcountll (c->u.words[w]
+                                       & word_range_mask (lo % 64,
+                                                          end - w * 64));
+          lo = end;
+        }
+      return cnt;
+
+    default:
+      for (i = run_upper_bound (c, lo); i > 0; i--)
+        if (c->u.runs[i - 1].last < lo)
+          break;
+      for (; i < c->len && c->u.runs[i].start < hi; i++)
+        {
+          uint32_t s = c->u.runs[i].start > lo ? c->u.runs[i].start : lo;
+          uint32_t e = (uint32_t) c->u.runs[i].last + 1 < hi
+                       ? (uint32_t) c->u.runs[i].last + 1 : hi;
+          cnt += e - s;
+        }
+      return cnt;
+    }
+}
+
+/* Returns the first bit at or after X that is set to VALUE in
+   container C, or CHUNK_BITS if there is none. */
+static uint32_t
+container_next (const struct container *c, uint32_t x, bool value)
+{
+  uint32_t i;
+
+  if (x >= CHUNK_BITS)
+    return CHUNK_BITS;
+
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      i = array_lower_bound (c, x);
+      if (value)
+        return i < c->len ? c->u.values[i] : CHUNK_BITS;
+      while (i < c->len && c->u.values[i] == x)
+        {
+          i++;
+          x++;
+        }
+      return x;
+
+    case BITSET_CONTAINER:
+      {
+        uint32_t w = x / 64;
+        uint64_t bits = (value ? c->u.words[w] : ~c->u.words[w])
+                        & (~(uint64_t) 0 << (x % 64));
+        while (bits == 0)
+          {
+            if (++w >= CHUNK_WORDS)
+              return CHUNK_BITS;
+            bits = value ? c->u.words[w] : ~c->u.words[w];
+          }
+        return w * 64 + __builtin_ctzll (bits);
+      }
+
+    default:
+      i = run_upper_bound (c, x);
+      if (i > 0 && c->u.runs[i - 1].last >= x)
+        return value ? x : (uint32_t) c->u.runs[i - 1].last + 1;
+      if (!value)
+        return x;
+      return i < c->len ? c->u.runs[i].start : CHUNK_BITS;
+    }
+}
+
+/* Returns the number of bytes used by container C's contents. */
+static size_t
+container_mem_size (const struct container *c)
+{
+  switch (c->type)
+    {
+    case ARRAY_CONTAINER:
+      return c->cap * sizeof (uint16_t);
+    case BITSET_CONTAINER:
+      return CHUNK_WORDS * sizeof (uint64_t);
+    default:
+      return c->cap * sizeof (struct run);
+    }
+}
+
+/* Chunk management. */
+
+/* Returns the position of the first container in R whose key is
+   at least KEY, or R->chunk_cnt if there is none. */
+static size_t
+find_chunk_pos (const struct roaring *r, size_t key)
+{
+  size_t lo = 0, hi = r->chunk_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (r->chunks[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the container for chunk KEY in R, or a null pointer
+   if that chunk has no bits set. */
+static struct container *
+find_chunk (const struct roaring *r, size_t key)
+{
+  size_t pos = find_chunk_pos (r, key);
+  return pos < r->chunk_cnt && r->chunks[pos].key == key
+         ? &r->chunks[pos] : NULL;
+}
+
+/* Inserts an empty array container for chunk KEY into R at
+   position POS and returns it, or returns a null pointer if
+   memory allocation failed.  The caller must add at least one
+   bit to it before returning to its own caller. */
+static struct container *
+insert_chunk (struct roaring *r, size_t pos, size_t key)
+{
+  struct container *c;
+
+  if (r->chunk_cnt == r->chunk_cap)
+    {
+      size_t cap = r->chunk_cap < 4 ? 4 : r->chunk_cap * 2;
+      struct container *chunks = realloc (r->chunks, cap * sizeof *chunks);
+      if (chunks == NULL)
+        return NULL;
+      r->chunks = chunks;
+      r->chunk_cap = cap;
+    }
+  memmove (&r->chunks[pos + 1], &r->chunks[pos],
+           (r->chunk_cnt - pos) * sizeof *r->chunks);
+  r->chunk_cnt++;
+
+  c = &r->chunks[pos];
+  c->key = key;
+  c->type = ARRAY_CONTAINER;
+  c->card = c->len = c->cap = 0;
+  c->u.values = NULL;
+  return c;
+}
+
+/* Removes the container at position POS from R. */
+static void
+remove_chunk (struct roaring *r, size_t pos)
+{
+  free (r->chunks[pos].u.values);
+  memmove (&r->chunks[pos], &r->chunks[pos + 1],
+           (r->chunk_cnt - pos - 1) * sizeof *r->chunks);
+  r->chunk_cnt--;
+}
+
+/* Sets bits LO through HI - 1 of chunk KEY in R to VALUE.
+   Returns true if successful, false if memory allocation
+   failed. */
+static bool
+set_chunk_range (struct roaring *r, size_t key, uint32_t lo, uint32_t hi,
+                 bool value)
+{
+  size_t pos = find_chunk_pos (r, key);
+  struct container *c = (pos < r->chunk_cnt && r->chunks[pos].key == key
+                         ? &r->chunks[pos] : NULL);
+  uint64_t words[CHUNK_WORDS];
+
+  if (!value)
+    {
+      if (c == NULL)
+        return true;
+      if (container_count (c, lo, hi) == c->card)
+        {
+          remove_chunk (r, pos);
+          return true;
+        }
+      container_to_words (c, words);
+      words_set_range (words, lo, hi, false);
+      return container_from_words (c, words);
+    }
+
+  if (c == NULL)
+    {
+      c = insert_chunk (r, pos, key);
+      if (c == NULL)
+        return false;
+      memset (words, 0, sizeof words);
+    }
+  else
+    container_to_words (c, words);
+  words_set_range (words, lo, hi, true);
+  if (!container_from_words (c, words))
+    {
+      if (c->card == 0)
+        remove_chunk (r, pos);
+      return false;
+    }
+  return true;
+}
+
+/* Returns the first bit at or after IDX in R that is set to
+   VALUE, or R->bit_cnt if there is none. */
+static size_t
+next_bit (const struct roaring *r, size_t idx, bool value)
+{
+  size_t pos = find_chunk_pos (r, chunk_key (idx));
+
+  while (idx < r->bit_cnt)
+    {
+      size_t key = chunk_key (idx);
+      uint32_t low;
+
+      if (pos >= r->chunk_cnt || r->chunks[pos].key != key)
+        {
+          /* Chunk KEY is all 0s. */
+          if (!value)
+            return idx;
+          if (pos >= r->chunk_cnt)
+            return r->bit_cnt;
+          idx = r->chunks[pos].key * CHUNK_BITS;
+          continue;
+        }
+
+      low = container_next (&r->chunks[pos], chunk_low (idx), value);
+      if (low < CHUNK_BITS)
+        {
+          idx = key * CHUNK_BITS + low;
+          break;
+        }
+      idx = (key + 1) * CHUNK_BITS;
+      pos++;
+    }
+  return idx < r->bit_cnt ? idx : r->bit_cnt;
+}
+
+/* Creation and destruction. */
+
+/* Creates and returns a roaring bitmap of BIT_CNT bits, all set
+   to false, or returns a null pointer if memory allocation
+   failed.  An empty roaring bitmap allocates no containers. */
+struct roaring *
+roaring_create (size_t bit_cnt)
+{
+  struct roaring *r = malloc (sizeof *r);
+
+  if (r != NULL)
+    {
+      r->bit_cnt = bit_cnt;
+      r->chunk_cnt = r->chunk_cap = 0;
+      r->chunks = NULL;
+    }
+  return r;
+}
+
+/* Destroys roaring bitmap R, freeing its storage. */
+void
+roaring_destroy (struct roaring *r)
+{
+  if (r != NULL)
+    {
+      size_t i;
+
+      for (i = 0; i < r->chunk_cnt; i++)
+        free (r->chunks[i].u.values);
+      free (r->chunks);
+      free (r);
+    }
+}
+
+/* Creates and returns a roaring bitmap with the same size and
+   contents as B, or returns a null pointer if memory allocation
+   failed.
+
+   Chunks are copied straight out of B's elements, whose byte
+   layout matches a bitset container's 64-bit words on a
+   little-endian machine such as the x86 that bitmap.c targets. */
+struct roaring *
+roaring_from_bitmap (const struct bitmap *b)
+{
+  const unsigned char *bytes = (const unsigned char *) b->bits;
+  size_t byte_cnt = DIV_ROUND_UP (b->bit_cnt, 8);
+  struct roaring *r = roaring_create (b->bit_cnt);
+  size_t key;
+
+  if (r == NULL)
+    return NULL;
+
+  for (key = 0; key * CHUNK_BITS < b->bit_cnt; key++)
+    {
+      size_t start = key * CHUNK_BITS;
+      size_t cnt = b->bit_cnt - start < CHUNK_BITS
+                   ? b->bit_cnt - start : CHUNK_BITS;
+      uint64_t words[CHUNK_WORDS];
+      size_t ofs = key * (CHUNK_BITS / 8);
+      size_t n = byte_cnt - ofs < sizeof words ? byte_cnt - ofs : sizeof words;
+      struct container *c;
+
+      if (!bitmap_any (b, start, cnt))
+        continue;
+
+      memset (words, 0, sizeof words);
+      memcpy (words, bytes + ofs, n);
+      c = insert_chunk (r, r->chunk_cnt, key);
+      if (c == NULL || !container_from_words (c, words))
+        {
+          if (c != NULL)
+            r->chunk_cnt--;
+          roaring_destroy (r);
+          return NULL;
+        }
+    }
+  return r;
+}
+
+/* Creates and returns a struct bitmap with the same size and
+   contents as R, or returns a null pointer if memory allocation
+   failed. */
+struct bitmap *
+roaring_to_bitmap (const struct roaring *r)
+{
+  struct bitmap *b = bitmap_create (r->bit_cnt);
+  unsigned char *bytes;
+  size_t byte_cnt, i;
+
+  if (b == NULL)
+    return NULL;
+
+  bytes = (unsigned char *) b->bits;
+  byte_cnt = DIV_ROUND_UP (r->bit_cnt, 8);
+  for (i = 0; i < r->chunk_cnt; i++)
+    {
+      uint64_t words[CHUNK_WORDS];
+      size_t ofs = r->chunks[i].key * (CHUNK_BITS / 8);
+      size_t n = byte_cnt - ofs < sizeof words ? byte_cnt - ofs : sizeof words;
+
+      container_to_words (&r->chunks[i], words);
+      memcpy (bytes + ofs, words, n);
+    }
+  return b;
+}
+
+/* Size. */
+
+/* Returns the number of bits in R. */
+size_t
+roaring_size (const struct roaring *r)
+{
+  return r->bit_cnt;
+}
+
+/* Returns the number of bytes of memory that R occupies. */
+size_t
+roaring_mem_size (const struct roaring *r)
+{
+  size_t size = sizeof *r + r->chunk_cap * sizeof *r->chunks;
+  size_t i;
+
+  for (i = 0; i < r->chunk_cnt; i++)
+    size += container_mem_size (&r->chunks[i]);
+  return size;
+}
+
+/* Setting and testing single bits. */
+
+/* Sets the bit numbered IDX in R to VALUE.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+roaring_set (struct roaring *r, size_t idx, bool value)
+{
+  ASSERT (r != NULL);
+  ASSERT (idx < r->bit_cnt);
+  if (value)
+    return roaring_mark (r, idx);
+  else
+    return roaring_reset (r, idx);
+}
+
+/* Sets the bit numbered IDX in R to true.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+roaring_mark (struct roaring *r, size_t idx)
+{
+  size_t key = chunk_key (idx);
+  size_t pos = find_chunk_pos (r, key);
+  struct container *c;
+
+  ASSERT (idx < r->bit_cnt);
+
+  if (pos < r->chunk_cnt && r->chunks[pos].key == key)
+    return container_add (&r->chunks[pos], chunk_low (idx));
+
+  c = insert_chunk (r, pos, key);
+  if (c == NULL)
+    return false;
+  if (!container_add (c, chunk_low (idx)))
+    {
+      remove_chunk (r, pos);
+      return false;
+    }
+  return true;
+}
+
+/* Sets the bit numbered IDX in R to false.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+roaring_reset (struct roaring *r, size_t idx)
+{
+  size_t key = chunk_key (idx);
+  size_t pos = find_chunk_pos (r, key);
+  struct container *c;
+
+  ASSERT (idx < r->bit_cnt);
+
+  if (pos >= r->chunk_cnt || r->chunks[pos].key != key)
+    return true;
+  c = &r->chunks[pos];
+  if (c->card == 1 && container_test (c, chunk_low (idx)))
+    {
+      remove_chunk (r, pos);
+      return true;
+    }
+  return container_remove (c, chunk_low (idx));
+}
+
+/* Toggles the bit numbered IDX in R.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+roaring_flip (struct roaring *r, size_t idx)
+{
+  return roaring_set (r, idx, !roaring_test (r, idx));
+}
+
+/* Returns the value of the bit numbered IDX in R. */
+bool
+roaring_test (const struct roaring *r, size_t idx)
+{
+  const struct container *c;
+
+  ASSERT (r != NULL);
+  ASSERT (idx < r->bit_cnt);
+
+  c = find_chunk (r, chunk_key (idx));
+  return c != NULL && container_test (c, chunk_low (idx));
+}
+
+/* Setting and testing multiple bits. */
+
+/* Sets all bits in R to VALUE.  Returns true if successful,
+   false if memory allocation failed. */
+bool
+roaring_set_all (struct roaring *r, bool value)
+{
+  ASSERT (r != NULL);
+
+  return roaring_set_multiple (r, 0, r->bit_cnt, value);
+}
+
+/* Sets the CNT bits starting at START in R to VALUE.  Returns
+   true if successful, false if memory allocation failed. */
+bool
+roaring_set_multiple (struct roaring *r, size_t start, size_t cnt, bool value)
+{
+  size_t end = start + cnt;
+
+  ASSERT (r != NULL);
+  ASSERT (start <= r->bit_cnt);
+  ASSERT (start + cnt <= r->bit_cnt);
+
+  while (start < end)
+    {
+      size_t key = chunk_key (start);
+      size_t chunk_end = (key + 1) * CHUNK_BITS;
+      uint32_t hi = end < chunk_end ? chunk_low (end - 1) + 1 : CHUNK_BITS;
+
+      if (!set_chunk_range (r, key, chunk_low (start), hi, value))
+        return false;
+      start = key * CHUNK_BITS + hi;
+    }
+  return true;
+}
+
+/* Returns the number of bits in R between START and START + CNT,
+   exclusive, that are set to VALUE. */
+size_t
+roaring_count (const struct roaring *r, size_t start, size_t cnt, bool value)
+{
+  size_t end = start + cnt;
+  size_t ones = 0;
+  size_t pos;
+
+  ASSERT (r != NULL);
+  ASSERT (start <= r->bit_cnt);
+  ASSERT (start + cnt <= r->bit_cnt);
+
+  if (cnt == 0)
+    return 0;
+  for (pos = find_chunk_pos (r, chunk_key (start));
+       pos < r->chunk_cnt && r->chunks[pos].key <= chunk_key (end - 1); pos++)
+    {
+      const struct container *c = &r->chunks[pos];
+      size_t base = c->key * CHUNK_BITS;
+      uint32_t lo = start > base ? start - base : 0;
+      uint32_t hi = end - base < CHUNK_BITS ? end - base : CHUNK_BITS;
+
+      ones += container_count (c, lo, hi);
+    }
+  return value ? ones : cnt - ones;
+}
+
+/* Returns true if any bits in R between START and START + CNT,
+   exclusive, are set to VALUE, and false otherwise. */
+bool
+roaring_contains (const struct roaring *r, size_t start, size_t cnt,
+                  bool value)
+{
+  ASSERT (r != NULL);
+  ASSERT (start <= r->bit_cnt);
+  ASSERT (start + cnt <= r->bit_cnt);
+
+  return cnt > 0 && next_bit (r, start, value) < start + cnt;
+}
+
+/* Returns true if any bits in R between START and START + CNT,
+   exclusive, are set to true, and false otherwise. */
+bool
+roaring_any (const struct roaring *r, size_t start, size_t cnt)
+{
+  return roaring_contains (r, start, cnt, true);
+}
+
+/* Returns true if no bits in R between START and START + CNT,
+   exclusive, are set to true, and false otherwise. */
+bool
+roaring_none (const struct roaring *r, size_t start, size_t cnt)
+{
+  return !roaring_contains (r, start, cnt, true);
+}
+
+/* Returns true if every bit in R between START and START + CNT,
+   exclusive, is set to true, and false otherwise. */
+bool
+roaring_all (const struct roaring *r, size_t start, size_t cnt)
+{
+  return !roaring_contains (r, start, cnt, false);
+}
+
+/* Finding set or unset bits. */
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in R at or after START that are all set to
+   VALUE.  If there is no such group, returns BITMAP_ERROR.
+
+   The search hops from one run of VALUE bits to the next, so
+   runs of 0s in chunks with no container cost nothing. */
+size_t
+roaring_scan (const struct roaring *r, size_t start, size_t cnt, bool value)
+{
+  size_t idx = start;
+
+  ASSERT (r != NULL);
+  ASSERT (start <= r->bit_cnt);
+
+  if (cnt > r->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  while (idx < r->bit_cnt)
+    {
+      size_t run_start = next_bit (r, idx, value);
+      size_t run_end = next_bit (r, run_start, !value);
+
+      if (run_end - run_start >= cnt)
+        return run_start;
+      idx = run_end;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Finds the first group of CNT consecutive bits in R at or after
+   START that are all set to VALUE, flips them all to !VALUE,
+   and returns the index of the first bit in the group.
+   If there is no such group, or if memory allocation failed,
+   returns BITMAP_ERROR. */
+size_t
+roaring_scan_and_flip (struct roaring *r, size_t start, size_t cnt,
+                       bool value)
+{
+  size_t idx = roaring_scan (r, start, cnt, value);
+  if (idx != BITMAP_ERROR && !roaring_set_multiple (r, idx, cnt, !value))
+    return BITMAP_ERROR;
+  return idx;
+}
+
+/* Combining roaring bitmaps. */
+
+/* Ways of combining two roaring bitmaps. */
+enum combine_op
+  {
+    COMBINE_AND,                /* A & B. */
+    COMBINE_OR,                 /* A | B. */
+    COMBINE_XOR,                /* A ^ B. */
+    COMBINE_ANDNOT              /* A & ~B. */
+  };
+
+/* Replaces the contents of DST by A combined with B according to
+   OP.  DST may be A or B.  Returns true if successful, false if
+   memory allocation failed, in which case DST is unchanged.
+
+   Chunks are merged by key.  A chunk missing from one side acts
+   as all 0s, and a chunk that comes out empty is dropped. */
+static bool
+combine_roaring (struct roaring *dst, const struct roaring *a,
+                 const struct roaring *b, enum combine_op op)
+{
+  struct roaring out;
+  size_t i = 0, j = 0, k;
+
+  ASSERT (dst != NULL && a != NULL && b != NULL);
+  ASSERT (a->bit_cnt == b->bit_cnt);
+  ASSERT (dst->bit_cnt == a->bit_cnt);
+
+  out.bit_cnt = dst->bit_cnt;
+  out.chunk_cnt = out.chunk_cap = 0;
+  out.chunks = NULL;
+  while (i < a->chunk_cnt || j < b->chunk_cnt)
+    {
+      const struct container *ca = i < a->chunk_cnt ? &a->chunks[i] : NULL;
+      const struct container *cb = j < b->chunk_cnt ? &b->chunks[j] : NULL;
+      uint64_t wa[CHUNK_WORDS], wb[CHUNK_WORDS];
+      bool any = false;
+      size_t key;
+      struct container *c;
+
+      if (cb == NULL || (ca != NULL && ca->key < cb->key))
+        {
+          key = ca->key;
+          cb = NULL;
+          i++;
+        }
+      else if (ca == NULL || cb->key < ca->key)
+        {
+          key = cb->key;
+          ca = NULL;
+          j++;
+        }
+      else
+        {
+          key = ca->key;
+          i++;
+          j++;
+        }
+
+      if ((ca == NULL && (op == COMBINE_AND || op == COMBINE_ANDNOT))
+          || (cb == NULL && op == COMBINE_AND))
+        continue;
+
+      if (ca != NULL)
+        container_to_words (ca, wa);
+      else
+        memset (wa, 0, sizeof wa);
+      if (cb != NULL)
+        container_to_words (cb, wb);
+      else
+        memset (wb, 0, sizeof wb);
+
+      for (k = 0; k < CHUNK_WORDS; k++)
+        {
+          switch (op)
+            {
+            case COMBINE_AND:
+              wa[k] &= wb[k];
+              break;
+            case COMBINE_OR:
+              wa[k] |= wb[k];
+              break;
+            case COMBINE_XOR:
+              wa[k] ^= wb[k];
+              break;
+            default:
+              wa[k] &= ~wb[k];
+              break;
+            }
+          any |= wa[k] != 0;
+        }
+      if (!any)
+        continue;
+
+      c = insert_chunk (&out, out.chunk_cnt, key);
+      if (c == NULL || !container_from_words (c, wa))
+        {
+          if (c != NULL)
+            out.chunk_cnt--;
+          for (k = 0; k < out.chunk_cnt; k++)
+            free (out.chunks[k].u.values);
+          free (out.chunks);
+          return false;
+        }
+    }
+
+  /* A and B have been read in full, so DST's old containers can
+     go even if DST is one of them. */
+  for (k = 0; k < dst->chunk_cnt; k++)
+    free (dst->chunks[k].u.values);
+  free (dst->chunks);
+  *dst = out;
+  return true;
+}
+
+/* Sets DST to A & B.  Returns true if successful, false if
+   memory allocation failed. */
+bool
+roaring_and (struct roaring *dst, const struct roaring *a,
+             const struct roaring *b)
+{
+  return combine_roaring (dst, a, b, COMBINE_AND);
+}
+
+/* Sets DST to A | B.  Returns true if successful, false if
+   memory allocation failed. */
+bool
+roaring_or (struct roaring *dst, const struct roaring *a,
+            const struct roaring *b)
+{
+  return combine_roaring (dst, a, b, COMBINE_OR);
+}
+
+/* Sets DST to A ^ B.  Returns true if successful, false if
+   memory allocation failed. */
+bool
+roaring_xor (struct roaring *dst, const struct roaring *a,
+             const struct roaring *b)
+{
+  return combine_roaring (dst, a, b, COMBINE_XOR);
+}
+
+/* Sets DST to A & ~B.  Returns true if successful, false if
+   memory allocation failed. */
+bool
+roaring_andnot (struct roaring *dst, const struct roaring *a,
+                const struct roaring *b)
+{
+  return combine_roaring (dst, a, b, COMBINE_ANDNOT);
+}
@@ -0,0 +1,71 @@
+#ifndef __MYLIB_ROARING_H
+#define __MYLIB_ROARING_H
+
+/* Compressed bitmap.
+
+   A roaring bitmap offers the same operations as struct bitmap,
+   but instead of storing one bit per index it splits the index
+   space into chunks of 65536 bits and keeps each chunk in
+   whichever of three containers is smallest for its contents:
+
+      - an array container, a sorted array of the low 16 bits
+        of each set bit, for chunks with few bits set;
+
+      - a bitset container, a plain 65536-bit bitmap, for dense
+        chunks;
+
+      - a run container, a sorted array of runs of consecutive
+        set bits, for chunks whose bits are clustered.
+
+   Chunks with no bits set take no space at all.  On sparse or
+   clustered data a roaring bitmap is typically 10 to 100 times
+   smaller than a struct bitmap of the same size.
+
+   The functions that modify a roaring bitmap may need to
+   allocate memory, so they return false if memory allocation
+   failed.  The bitmap is unchanged in that case, except that a
+   failed range operation may have been partially applied. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "bitmap.h"
+
+struct roaring;
+
+/* Creation and destruction. */
+struct roaring *roaring_create (size_t bit_cnt);
+void roaring_destroy (struct roaring *);
+struct roaring *roaring_from_bitmap (const struct bitmap *);
+struct bitmap *roaring_to_bitmap (const struct roaring *);
+
+/* Size. */
+size_t roaring_size (const struct roaring *);
+size_t roaring_mem_size (const struct roaring *);
+
+/* Setting and testing single bits. */
+bool roaring_set (struct roaring *, size_t idx, bool);
+bool roaring_mark (struct roaring *, size_t idx);
+bool roaring_reset (struct roaring *, size_t idx);
+bool roaring_flip (struct roaring *, size_t idx);
+bool roaring_test (const struct roaring *, size_t idx);
+
+/* Setting and testing multiple bits. */
+bool roaring_set_all (struct roaring *, bool);
+bool roaring_set_multiple (struct roaring *, size_t start, size_t cnt, bool);
+size_t roaring_count (const struct roaring *, size_t start, size_t cnt, bool);
+bool roaring_contains (const struct roaring *, size_t start, size_t cnt, bool);
+bool roaring_any (const struct roaring *, size_t start, size_t cnt);
+bool roaring_none (const struct roaring *, size_t start, size_t cnt);
+bool roaring_all (const struct roaring *, size_t start, size_t cnt);
+
+/* Finding set or unset bits. */
+size_t roaring_scan (const struct roaring *, size_t start, size_t cnt, bool);
+size_t roaring_scan_and_flip (struct roaring *, size_t start, size_t cnt, bool);
+
+/* Combining roaring bitmaps of equal size. */
+bool roaring_and (struct roaring *dst, const struct roaring *, const struct roaring *);
+bool roaring_or (struct roaring *dst, const struct roaring *, const struct roaring *);
+bool roaring_xor (struct roaring *dst, const struct roaring *, const struct roaring *);
+bool roaring_andnot (struct roaring *dst, const struct roaring *, const struct roaring *);
+
+#endif /* roaring.h */
@@ -0,0 +1,243 @@
+/* Sharded bitmap allocator.
+
+   See sbitmap.h for basic information. */
+
+#include "sbitmap.h"
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "round.h"
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Number of bits in a bitmap element.  Shards are made of whole
+   elements so that no two shards ever write the same one. */
+#define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
+
+/* Size of a cache line.  Each shard gets its own, so that
+   threads working on neighbouring shards do not make one
+   another's lock and rotor bounce between caches. */
+#define CACHE_LINE 64
+
+/* One shard: bits START through END - 1 of the bitmap. */
+struct shard
+  {
+    pthread_mutex_t lock;       /* Protects the rest and the bits. */
+    size_t start;               /* First bit. */
+    size_t end;                 /* One past the last bit. */
+    size_t rotor;               /* Where the next scan starts. */
+    size_t free_cnt;            /* Number of bits set to false. */
+  }
+__attribute__ ((aligned (CACHE_LINE)));
+
+/* Sharded bitmap. */
+struct sbitmap
+  {
+    struct bitmap *bits;        /* The whole bitmap. */
+    size_t shard_bits;          /* Bits per shard, except the last. */
+    size_t shard_cnt;           /* Number of shards. */
+    struct shard *shards;       /* The shards. */
+  };
+
+/* Source of home shards for threads that have none yet. */
+static atomic_size_t next_home;
+
+/* This thread's home shard number, before reducing it modulo
+   the number of shards, or SIZE_MAX if it has none yet. */
+static _Thread_local size_t home = SIZE_MAX;
+
+/* Returns the shard of SB that holds bit IDX. */
+static inline struct shard *
+shard_of (struct sbitmap *sb, size_t idx)
+{
+  return &sb->shards[idx / sb->shard_bits];
+}
+
+/* Tries to allocate CNT consecutive free bits from shard S of
+   SB, next fit from its rotor.  Returns the index of the first
+   bit, or BITMAP_ERROR if the shard has no room. */
+static size_t
+shard_alloc (struct sbitmap *sb, struct shard *s, size_t cnt)
+{
+  size_t idx = BITMAP_ERROR;
+
+  pthread_mutex_lock (&s->lock);
+  if (s->free_cnt >= cnt)
+    {
+      idx = bitmap_scan_range (sb->bits, s->rotor, s->end, cnt, false);
+      if (idx == BITMAP_ERROR && s->rotor > s->start)
+        {
+          /* Groups that start before the rotor may run past it. */
+          size_t end = s->rotor + cnt - 1;
+          idx = bitmap_scan_range (sb->bits, s->start,
+                                   end < s->end ? end : s->end, cnt, false);
+        }
+      if (idx != BITMAP_ERROR)
+        {
+          bitmap_set_multiple (sb->bits, idx, cnt, true);
+          s->free_cnt -= cnt;
+          s->rotor = idx + cnt < s->end ? idx + cnt : s->start;
+        }
+    }
+  pthread_mutex_unlock (&s->lock);
+  return idx;
+}
+
+/* Creation and destruction. */
+
+/* Creates and returns a sharded bitmap of BIT_CNT bits, all
+   free, divided into SHARD_CNT shards of about equal size, one
+   per processor being a good choice.  There may be fewer shards
+   than requested, because every shard holds at least one whole
+   element.  Returns a null pointer if memory allocation
+   failed. */
+struct sbitmap *
+sbitmap_create (size_t bit_cnt, size_t shard_cnt)
+{
+  struct sbitmap *sb;
+  size_t i;
+
+  ASSERT (bit_cnt > 0);
+  ASSERT (shard_cnt > 0);
+
+  sb = malloc (sizeof *sb);
+  if (sb == NULL)
+    return NULL;
+  sb->bits = bitmap_create (bit_cnt);
+  sb->shard_bits = ROUND_UP (DIV_ROUND_UP (bit_cnt, shard_cnt), ELEM_BITS);
+  sb->shard_cnt = DIV_ROUND_UP (bit_cnt, sb->shard_bits);
+  sb->shards = aligned_alloc (CACHE_LINE, sb->shard_cnt * sizeof *sb->shards);
+  if (sb->bits == NULL || sb->shards == NULL)
+    {
+      bitmap_destroy (sb->bits);
+      free (sb->shards);
+      free (sb);
+      return NULL;
+    }
+
+  for (i = 0; i < sb->shard_cnt; i++)
+    {
+      struct shard *s = &sb->shards[i];
+
+      pthread_mutex_init (&s->lock, NULL);
+      s->start = s->rotor = i * sb->shard_bits;
+      s->end = s->start + sb->shard_bits < bit_cnt
+               ? s->start + sb->shard_bits : bit_cnt;
+      s->free_cnt = s->end - s->start;
+    }
+  return sb;
+}
+
+/* Destroys sharded bitmap SB, freeing its storage.  No other
+   thread may be using SB. */
+void
+sbitmap_destroy (struct sbitmap *sb)
+{
+  if (sb != NULL)
+    {
+      size_t i;
+
+      for (i = 0; i < sb->shard_cnt; i++)
+        pthread_mutex_destroy (&sb->shards[i].lock);
+      free (sb->shards);
+      bitmap_destroy (sb->bits);
+      free (sb);
+    }
+}
+
+/* Size. */
+
+/* Returns the number of bits in SB. */
+size_t
+sbitmap_size (const struct sbitmap *sb)
+{
+  return bitmap_size (sb->bits);
+}
+
+/* Returns the number of shards in SB. */
+size_t
+sbitmap_shard_cnt (const struct sbitmap *sb)
+{
+  return sb->shard_cnt;
+}
+
+/* Returns the number of bits in each shard of SB, except that
+   the last shard may be smaller.  No allocation can be larger
+   than this. */
+size_t
+sbitmap_shard_size (const struct sbitmap *sb)
+{
+  return sb->shard_bits;
+}
+
+/* Allocation. */
+
+/* Finds CNT consecutive free bits in SB, all within one shard,
+   marks them allocated, and returns the index of the first one.
+   The calling thread's home shard is tried first, then each of
+   the following shards in turn.  Returns BITMAP_ERROR if no
+   shard has room.  If CNT is zero, returns 0. */
+size_t
+sbitmap_alloc (struct sbitmap *sb, size_t cnt)
+{
+  size_t first, i;
+
+  ASSERT (sb != NULL);
+
+  if (cnt == 0)
+    return 0;
+  if (cnt > sb->shard_bits)
+    return BITMAP_ERROR;
+
+  if (home == SIZE_MAX)
+    home = atomic_fetch_add (&next_home, 1);
+  first = home % sb->shard_cnt;
+  for (i = 0; i < sb->shard_cnt; i++)
+    {
+      size_t idx = shard_alloc (sb, &sb->shards[(first + i) % sb->shard_cnt],
+                                cnt);
+      if (idx != BITMAP_ERROR)
+        return idx;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Frees the CNT bits starting at IDX in SB, which must have been
+   allocated together by sbitmap_alloc(). */
+void
+sbitmap_free (struct sbitmap *sb, size_t idx, size_t cnt)
+{
+  struct shard *s;
+
+  ASSERT (sb != NULL);
+
+  if (cnt == 0)
+    return;
+  s = shard_of (sb, idx);
+  ASSERT (idx + cnt <= s->end);
+
+  pthread_mutex_lock (&s->lock);
+  ASSERT (bitmap_all (sb->bits, idx, cnt));
+  bitmap_set_multiple (sb->bits, idx, cnt, false);
+  s->free_cnt += cnt;
+  pthread_mutex_unlock (&s->lock);
+}
+
+/* Returns true if bit IDX of SB is allocated, false otherwise. */
+bool
+sbitmap_test (struct sbitmap *sb, size_t idx)
+{
+  struct shard *s;
+  bool allocated;
+
+  ASSERT (sb != NULL);
+  ASSERT (idx < sbitmap_size (sb));
+
+  s = shard_of (sb, idx);
+  pthread_mutex_lock (&s->lock);
+  allocated = bitmap_test (sb->bits, idx);
+  pthread_mutex_unlock (&s->lock);
+  return allocated;
+}
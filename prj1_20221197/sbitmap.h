@@ -0,0 +1,44 @@
+#ifndef __MYLIB_SBITMAP_H
+#define __MYLIB_SBITMAP_H
+
+/* Sharded bitmap allocator.
+
+   A sharded bitmap is one bitmap, with the same index space as
+   a struct bitmap of the same size, that is divided into shards,
+   each a range of whole elements with its own lock and its own
+   next-fit rotor.  Each thread that allocates from it has a home
+   shard, so threads on different processors mostly work on
+   different shards and different cache lines and do not wait for
+   one another, where calls to bitmap_scan_and_flip() on a shared
+   bitmap would all have to be serialized.
+
+   An allocation looks for CNT consecutive free bits in the
+   thread's home shard first.  Only when that shard has no room
+   does it steal from the other shards, trying its neighbours in
+   order.  An allocated group never spans two shards, so CNT may
+   not be larger than a shard.
+
+   All of the functions here may be called from any number of
+   threads at once, except sbitmap_destroy(). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "bitmap.h"
+
+struct sbitmap;
+
+/* Creation and destruction. */
+struct sbitmap *sbitmap_create (size_t bit_cnt, size_t shard_cnt);
+void sbitmap_destroy (struct sbitmap *);
+
+/* Size. */
+size_t sbitmap_size (const struct sbitmap *);
+size_t sbitmap_shard_cnt (const struct sbitmap *);
+size_t sbitmap_shard_size (const struct sbitmap *);
+
+/* Allocation. */
+size_t sbitmap_alloc (struct sbitmap *, size_t cnt);
+void sbitmap_free (struct sbitmap *, size_t idx, size_t cnt);
+bool sbitmap_test (struct sbitmap *, size_t idx);
+
+#endif /* sbitmap.h */